@@ -0,0 +1,230 @@
+#include "HRTF.hpp"
+
+#include "mix_kernels.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+	//radix-2 FFT of FFTSize complex values, kept as separate real and imaginary arrays (unscaled, in place).
+	// The inverse transform is the same thing with the arrays swapped: forward(im, re) leaves FFTSize * the
+	// inverse transform in (re, im).
+	struct FFT {
+		static constexpr uint32_t const N = HRTF::FFTSize;
+		static_assert((N & (N - 1)) == 0, "FFT size is a power of two");
+
+		FFT() {
+			uint32_t bits = 0;
+			while ((1U << bits) < N) ++bits;
+			for (uint32_t i = 0; i < N; ++i) {
+				uint32_t r = 0;
+				for (uint32_t b = 0; b < bits; ++b) {
+					if (i & (1U << b)) r |= 1U << (bits - 1 - b);
+				}
+				reverse[i] = r;
+			}
+			for (uint32_t k = 0; k < N / 2; ++k) {
+				double angle = 2.0 * 3.14159265358979323846 * double(k) / double(N);
+				twiddle_re[k] = float(std::cos(angle));
+				twiddle_im[k] = float(-std::sin(angle));
+			}
+		}
+
+		void forward(float *re, float *im) const {
+			for (uint32_t i = 0; i < N; ++i) {
+				uint32_t r = reverse[i];
+				if (r > i) {
+					std::swap(re[i], re[r]);
+					std::swap(im[i], im[r]);
+				}
+			}
+			for (uint32_t size = 2; size <= N; size *= 2) {
+				uint32_t const half = size / 2;
+				uint32_t const stride = N / size;
+				for (uint32_t start = 0; start < N; start += size) {
+					for (uint32_t k = 0; k < half; ++k) {
+						float wr = twiddle_re[k * stride];
+						float wi = twiddle_im[k * stride];
+						uint32_t a = start + k;
+						uint32_t b = a + half;
+						float tr = re[b] * wr - im[b] * wi;
+						float ti = re[b] * wi + im[b] * wr;
+						re[b] = re[a] - tr;
+						im[b] = im[a] - ti;
+						re[a] += tr;
+						im[a] += ti;
+					}
+				}
+			}
+		}
+
+		uint32_t reverse[N];
+		float twiddle_re[N / 2], twiddle_im[N / 2];
+	};
+	FFT const fft;
+}
+
+HRTF::Set::Set(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open HRIR file '" + filename + "'.");
+	}
+	std::vector< float > degrees, hrirs;
+	read_chunk(file, "hraz", &degrees);
+	read_chunk(file, "hrir", &hrirs);
+
+	if (degrees.size() < 3 || degrees.size() > MaxSpeakers) {
+		throw std::runtime_error("HRIR file '" + filename + "' has " + std::to_string(degrees.size()) + " speakers; expecting 3 to " + std::to_string(MaxSpeakers) + ".");
+	}
+	speakers = uint32_t(degrees.size());
+	for (uint32_t s = 0; s < speakers; ++s) {
+		if (!(degrees[s] >= 0.0f && degrees[s] < 360.0f) || (s > 0 && !(degrees[s] > degrees[s-1]))) {
+			throw std::runtime_error("HRIR file '" + filename + "' has speaker azimuths that aren't increasing, in [0, 360).");
+		}
+		azimuths[s] = degrees[s] / 180.0f * 3.14159265f;
+	}
+	if (hrirs.empty() || hrirs.size() % (2 * speakers) != 0 || hrirs.size() / (2 * speakers) > MaxLength) {
+		throw std::runtime_error("HRIR file '" + filename + "' doesn't have two HRIRs of the same length (at most " + std::to_string(MaxLength) + " frames) for each speaker.");
+	}
+	uint32_t length = uint32_t(hrirs.size() / (2 * speakers));
+	partitions = (length + Partition - 1) / Partition;
+
+	//spectra of each piece (with the FFT's scale, and a factor of two that Renderer::process saves, folded in):
+	spectra.assign(size_t(speakers) * 2 * partitions * 2 * Bins, 0.0f);
+	float re[FFTSize], im[FFTSize];
+	for (uint32_t s = 0; s < speakers; ++s) {
+		for (uint32_t e = 0; e < 2; ++e) {
+			float const *hrir = hrirs.data() + size_t(s * 2 + e) * length;
+			for (uint32_t p = 0; p < partitions; ++p) {
+				for (uint32_t i = 0; i < FFTSize; ++i) {
+					uint32_t at = p * Partition + i;
+					re[i] = (i < Partition && at < length ? hrir[at] : 0.0f);
+					im[i] = 0.0f;
+				}
+				fft.forward(re, im);
+				float *spectrum = spectra.data() + size_t((s * 2 + e) * partitions + p) * 2 * Bins;
+				for (uint32_t k = 0; k < Bins; ++k) {
+					spectrum[k] = re[k] / float(2 * FFTSize);
+					spectrum[Bins + k] = im[k] / float(2 * FFTSize);
+				}
+			}
+		}
+	}
+}
+
+HRTF::Renderer::Renderer(std::shared_ptr< Set const > const &set_) : set(set_) {
+	assert(set);
+	history.assign(size_t(set->speakers) * Partition, 0.0f);
+	std::fill(history_silent, history_silent + MaxSpeakers, true);
+	delay_line.assign(size_t(set->speakers) * set->partitions * 2 * Bins, 0.0f);
+	delay_silent.assign(size_t(set->speakers) * set->partitions, true);
+	work.assign(2 * FFTSize, 0.0f);
+	sum[0].assign(2 * Bins, 0.0f);
+	sum[1].assign(2 * Bins, 0.0f);
+}
+
+bool HRTF::Renderer::process(float const * const *feeds, uint32_t count, float *out) {
+	assert(count % Partition == 0);
+	Set const &hrirs = *set;
+	uint32_t const speakers = hrirs.speakers;
+	uint32_t const partitions = hrirs.partitions;
+	float *re = work.data();
+	float *im = work.data() + FFTSize;
+
+	bool audible = false;
+	for (uint32_t offset = 0; offset < count; offset += Partition) {
+		head = (head + 1) % partitions;
+
+		//transform the newest window (previous partition + this one) of two speakers at once,
+		// one as the real part and one as the imaginary part:
+		for (uint32_t s = 0; s < speakers; s += 2) {
+			uint32_t const pair[2] = {s, s + 1};
+			bool silent[2];
+			for (uint32_t j = 0; j < 2; ++j) {
+				uint32_t t = pair[j];
+				silent[j] = (t >= speakers || (!feeds[t] && history_silent[t]));
+				if (t < speakers) delay_silent[t * partitions + head] = silent[j];
+			}
+			if (silent[0] && silent[1]) continue;
+
+			for (uint32_t j = 0; j < 2; ++j) {
+				uint32_t t = pair[j];
+				float *window = (j == 0 ? re : im);
+				if (silent[j]) {
+					std::fill(window, window + FFTSize, 0.0f);
+					continue;
+				}
+				float *previous = history.data() + size_t(t) * Partition;
+				std::copy(previous, previous + Partition, window);
+				if (feeds[t]) {
+					std::copy(feeds[t] + offset, feeds[t] + offset + Partition, window + Partition);
+				} else {
+					std::fill(window + Partition, window + FFTSize, 0.0f);
+				}
+				std::copy(window + Partition, window + FFTSize, previous);
+				history_silent[t] = (feeds[t] == nullptr);
+			}
+
+			fft.forward(re, im);
+
+			//split the two (real) signals' spectra apart, using the symmetry of each: (twice the actual values)
+			float *a = delay_line.data() + size_t(s * partitions + head) * 2 * Bins;
+			float *b = (s + 1 < speakers ? delay_line.data() + size_t((s + 1) * partitions + head) * 2 * Bins : nullptr);
+			for (uint32_t k = 0; k < Bins; ++k) {
+				uint32_t m = (FFTSize - k) % FFTSize;
+				a[k] = re[k] + re[m];
+				a[Bins + k] = im[k] - im[m];
+				if (b) {
+					b[k] = im[k] + im[m];
+					b[Bins + k] = re[m] - re[k];
+				}
+			}
+		}
+
+		//sum each ear's spectrum over every speaker's recent inputs times the matching HRIR pieces:
+		bool step_audible = false;
+		std::fill(sum[0].begin(), sum[0].end(), 0.0f);
+		std::fill(sum[1].begin(), sum[1].end(), 0.0f);
+		for (uint32_t s = 0; s < speakers; ++s) {
+			for (uint32_t p = 0; p < partitions; ++p) {
+				uint32_t slot = (head + partitions - p) % partitions;
+				if (delay_silent[s * partitions + slot]) continue;
+				step_audible = true;
+				float const *x = delay_line.data() + size_t(s * partitions + slot) * 2 * Bins;
+				for (uint32_t e = 0; e < 2; ++e) {
+					float const *h = hrirs.spectrum(s, e, p);
+					multiply_add_spectrum(Bins, x, x + Bins, h, h + Bins, sum[e].data(), sum[e].data() + Bins);
+				}
+			}
+		}
+		if (!step_audible) continue;
+		audible = true;
+
+		//transform both ears back at once, left as the real part and right as the imaginary part:
+		// (filling in the upper half of each spectrum as the mirror image of the lower half)
+		float const *left_re = sum[0].data(), *left_im = sum[0].data() + Bins;
+		float const *right_re = sum[1].data(), *right_im = sum[1].data() + Bins;
+		for (uint32_t k = 0; k < Bins; ++k) {
+			re[k] = left_re[k] - right_im[k];
+			im[k] = left_im[k] + right_re[k];
+		}
+		for (uint32_t k = Bins; k < FFTSize; ++k) {
+			uint32_t m = FFTSize - k;
+			re[k] = left_re[m] + right_im[m];
+			im[k] = right_re[m] - left_im[m];
+		}
+		fft.forward(im, re);
+
+		//(the first half of the window wrapped around, so only the second half is kept)
+		float *dst = out + 2 * size_t(offset);
+		for (uint32_t i = 0; i < Partition; ++i) {
+			dst[2*i+0] += re[Partition + i];
+			dst[2*i+1] += im[Partition + i];
+		}
+	}
+	return audible;
+}
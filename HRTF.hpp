@@ -0,0 +1,74 @@
+#pragma once
+
+//Binaural ("headphone 3D") filtering with head-related transfer functions, for Sound::set_binaural.
+//
+//On the way to each ear, sound is shaped by the head and the ear itself, differently for every direction;
+// a head-related impulse response (HRIR) records that shaping for one direction and one ear. Rather than filter
+// every playing sample by the HRIRs for its own direction, the mixer pans 3D samples between a ring of "virtual
+// speakers" around the listener (as it would for a surround system), and only each speaker's feed is filtered
+// -- by the HRIRs for that speaker's direction -- so the cost doesn't grow with the number of samples playing.
+//
+//Filtering is uniformly partitioned FFT convolution (overlap-save): each HRIR is cut into Partition-frame
+// pieces, whose spectra are computed once, at load. Then, every Partition frames, each speaker's newest input
+// is transformed, its spectrum and those of its recent inputs are multiplied by the spectra of the matching
+// pieces (see multiply_add_spectrum in mix_kernels.hpp) and summed for each ear, and the sums are transformed back.
+//
+//HRIR files are chunk files (see read_write_chunk.hpp) of 48kHz floats:
+// "hraz" -- the azimuth of each virtual speaker, in degrees (0 is straight ahead, 90 is to the right),
+//           increasing, in [0, 360); there must be at least 3 and at most MaxSpeakers
+// "hrir" -- for each speaker, in the same order: its left-ear HRIR, then its right-ear HRIR (all the same length)
+//(make-hrir.py writes one from a simple model of a head)
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace HRTF {
+
+constexpr uint32_t const Partition = 128; //frames per convolution step (process() takes multiples of this)
+constexpr uint32_t const FFTSize = 2 * Partition;
+constexpr uint32_t const Bins = FFTSize / 2 + 1; //(the rest of a real signal's spectrum mirrors these)
+constexpr uint32_t const MaxSpeakers = 8;
+constexpr uint32_t const MaxLength = 8192; //longest HRIR accepted, in frames
+
+//HRIRs, ready for convolution; never changes once loaded, so it can be shared between threads:
+struct Set {
+	Set(std::string const &filename); //throws on error
+
+	uint32_t speakers = 0;
+	float azimuths[MaxSpeakers] = {}; //radians, increasing, in [0, 2pi)
+	uint32_t partitions = 0; //pieces each HRIR was cut into
+
+	//spectrum of piece 'p' of the HRIR for speaker 's' and ear 'e' (0 is left, 1 is right),
+	// as Bins real parts followed by Bins imaginary parts:
+	float const *spectrum(uint32_t s, uint32_t e, uint32_t p) const {
+		return spectra.data() + size_t((s * 2 + e) * partitions + p) * 2 * Bins;
+	}
+	std::vector< float > spectra;
+};
+
+//Convolution state for one set of speaker feeds (e.g., one bus); audio thread only:
+struct Renderer {
+	Renderer(std::shared_ptr< Set const > const &set);
+
+	//filter 'count' frames (a multiple of Partition) of 'feeds' -- one mono buffer per speaker, or null if it is silent --
+	// and add the result to 'out' (interleaved left, right); returns false (and leaves 'out' alone) if the result is silent:
+	bool process(float const * const *feeds, uint32_t count, float *out);
+
+	std::shared_ptr< Set const > set;
+
+	//internals:
+	//the previous Partition frames of each speaker's feed (overlap-save needs two partitions at a time):
+	std::vector< float > history; //[speaker][Partition]
+	bool history_silent[MaxSpeakers];
+	//"frequency-domain delay line": spectra of each speaker's most recent 'partitions' inputs, newest at 'head':
+	std::vector< float > delay_line; //[speaker][partition][2 * Bins]
+	std::vector< bool > delay_silent; //[speaker][partition]
+	uint32_t head = 0;
+	//scratch space for one step:
+	std::vector< float > work; //FFTSize real, FFTSize imaginary
+	std::vector< float > sum[2]; //per ear: Bins real, Bins imaginary
+};
+
+}
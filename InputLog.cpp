@@ -0,0 +1,101 @@
+#include "InputLog.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	struct Header {
+		char magic[4] = {'i', 'n', 'p', 't'};
+		uint32_t version = 2;
+		uint32_t event_size = sizeof(SDL_Event);
+	};
+	static_assert(sizeof(Header) == 12, "Header is packed");
+
+	static_assert(sizeof(SDL_Event) < 256, "Event length fits in one byte");
+
+	//does 'evt' point at memory that won't be there at replay time?
+	bool has_pointers(SDL_Event const &evt) {
+		return evt.type == SDL_DROPFILE || evt.type == SDL_DROPTEXT //drop.file
+		    || evt.type == SDL_SYSWMEVENT //syswm.msg
+		    || (evt.type >= SDL_USEREVENT && evt.type < SDL_LASTEVENT); //user.data1, user.data2
+	}
+}
+
+InputRecorder::InputRecorder(std::string const &filename) : out(filename, std::ios::binary) {
+	if (!out.is_open()) {
+		throw std::runtime_error("Failed to open '" + filename + "' for recording input.");
+	}
+	Header header;
+	out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+}
+
+InputRecorder::~InputRecorder() {
+	out.flush();
+}
+
+void InputRecorder::event(SDL_Event const &evt) {
+	if (has_pointers(evt)) return;
+
+	//most of an SDL_Event is unused padding, so only store up to the last nonzero byte:
+	uint8_t const *bytes = reinterpret_cast< uint8_t const * >(&evt);
+	uint8_t length = uint8_t(sizeof(SDL_Event));
+	while (length > 0 && bytes[length-1] == 0) --length;
+
+	out.put('E');
+	out.put(char(length));
+	out.write(reinterpret_cast< char const * >(bytes), length);
+}
+
+void InputRecorder::update(float elapsed) {
+	out.put('U');
+	out.write(reinterpret_cast< char const * >(&elapsed), sizeof(elapsed));
+}
+
+//------------------
+
+InputReplayer::InputReplayer(std::string const &filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open()) {
+		throw std::runtime_error("Failed to open '" + filename + "' for replaying input.");
+	}
+	data.assign(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+
+	Header expected, header;
+	if (data.size() < sizeof(header)) {
+		throw std::runtime_error("Input log '" + filename + "' is too short.");
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::memcmp(header.magic, expected.magic, 4) != 0 || header.version != expected.version) {
+		throw std::runtime_error("Input log '" + filename + "' has an unexpected magic number or version.");
+	}
+	if (header.event_size != expected.event_size) {
+		throw std::runtime_error("Input log '" + filename + "' was recorded with a different SDL_Event size.");
+	}
+	offset = sizeof(header);
+}
+
+bool InputReplayer::poll_event(SDL_Event *evt) {
+	assert(evt);
+	//events are: 'E' + length + bytes
+	if (offset + 2 > data.size() || data[offset] != 'E') return false;
+	uint8_t length = uint8_t(data[offset + 1]);
+	if (length > sizeof(SDL_Event) || offset + 2 + length > data.size()) {
+		offset = data.size(); //truncated log; stop replaying
+		return false;
+	}
+	SDL_zerop(evt);
+	std::memcpy(evt, data.data() + offset + 2, length);
+	offset += 2 + length;
+	return true;
+}
+
+bool InputReplayer::update(float *elapsed) {
+	assert(elapsed);
+	//updates are: 'U' + elapsed
+	if (offset + 1 + sizeof(float) > data.size() || data[offset] != 'U') return false;
+	std::memcpy(elapsed, data.data() + offset + 1, sizeof(float));
+	offset += 1 + sizeof(float);
+	frames += 1;
+	return true;
+}
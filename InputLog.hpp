@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+ * InputRecorder and InputReplayer capture a play session as a compact binary log
+ * of the SDL_Events and 'elapsed' values seen by the main loop, so that sessions
+ * can be played back exactly (e.g., for performance captures or regression runs).
+ *
+ * Log format:
+ *  |in|pt| version (uint32) sizeof(SDL_Event) (uint32)
+ *  then records, each starting with a one-byte kind:
+ *   'E' length (uint8) event bytes
+ *       (events are stored with trailing zero bytes trimmed; replay is paced by the 'U' records,
+ *        and each event still carries its own SDL timestamp)
+ *   'U' elapsed (float) -- the value passed to Mode::update; ends a frame
+ *
+ * Events that carry pointers (dropped files and text, window manager messages, and
+ * user events) aren't recorded, since the pointers would dangle by replay time.
+ */
+
+#include <SDL.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct InputRecorder {
+	InputRecorder(std::string const &filename); //throws on error
+	~InputRecorder();
+
+	//call for every event the main loop sees (skips the ones that can't be replayed; see above):
+	void event(SDL_Event const &evt);
+	//call with the elapsed time passed to Mode::update (ends the frame):
+	void update(float elapsed);
+
+	std::ofstream out;
+};
+
+struct InputReplayer {
+	InputReplayer(std::string const &filename); //throws on error
+
+	//returns the next event recorded in the current frame, or false if there are no more:
+	bool poll_event(SDL_Event *evt);
+	//returns the elapsed time recorded for the end of the current frame, or false if the log is over:
+	bool update(float *elapsed);
+
+	std::vector< char > data;
+	size_t offset = 0;
+	uint32_t frames = 0; //frames replayed so far
+};
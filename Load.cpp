@@ -1,7 +1,15 @@
 #include "Load.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
 #include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <cassert>
 
 namespace {
@@ -23,9 +31,64 @@ void call_load_functions() {
 	has_been_called = true;
 
 	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
+
+	//parallel functions are claimed one at a time (by index) by the workers and, once it's done with the early functions, the main thread:
+	std::vector< std::function< void() > > parallel(load_lists[LoadTagParallel].begin(), load_lists[LoadTagParallel].end());
+	load_lists[LoadTagParallel].clear();
+	std::atomic< size_t > next_parallel(0);
+	std::mutex error_mutex;
+	std::exception_ptr error; //first exception thrown by a parallel function
+	//(total time spent in parallel functions, to compare with how long they took all together)
+	std::atomic< int64_t > parallel_work_ns(0);
+	auto run_parallel = [&]() {
+		for (size_t i = next_parallel++; i < parallel.size(); i = next_parallel++) {
+			auto before = std::chrono::steady_clock::now();
+			try {
+				parallel[i]();
+			} catch (...) {
+				std::unique_lock< std::mutex > lock(error_mutex);
+				if (!error) error = std::current_exception();
+			}
+			parallel_work_ns += std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - before).count();
+		}
+	};
+
+	auto parallel_start = std::chrono::steady_clock::now();
+	std::vector< std::thread > workers;
+	if (parallel.size() > 1) {
+		size_t count = std::max(1U, std::thread::hardware_concurrency()) - 1; //(the main thread helps too)
+		count = std::min(count, parallel.size());
+		for (size_t w = 0; w < count; ++w) {
+			workers.emplace_back(run_parallel);
+		}
+	}
+	auto join_parallel = [&]() {
+		run_parallel();
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	};
+
+	for (uint32_t tag = 0; tag < MaxLoadTag; ++tag) {
+		if (tag == LoadTagDefault) {
+			//everything after this may use what the parallel functions loaded:
+			join_parallel();
+			if (error) std::rethrow_exception(error);
+			if (!parallel.empty()) {
+				std::chrono::duration< double, std::milli > elapsed = std::chrono::steady_clock::now() - parallel_start;
+				std::cout << "Parallel loads: " << parallel.size() << " took " << elapsed.count() << "ms"
+					<< " (" << double(parallel_work_ns.load()) * 1.0e-6 << "ms one after another; early loads ran alongside)." << std::endl;
+			}
+		}
+		auto &fn_list = load_lists[tag];
 		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
+			try {
+				(*fn_list.begin())(); //call first function in the list
+			} catch (...) {
+				join_parallel(); //(workers can't be left running when the exception leaves this function)
+				throw;
+			}
 			fn_list.pop_front(); //remove from list
 		}
 	}
@@ -20,12 +20,25 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Functions tagged LoadTagParallel run on worker threads, alongside the LoadTagEarly functions, and are
+ * all finished before any LoadTagDefault function starts. This is meant for slow loads that don't need
+ * OpenGL and don't depend on each other -- e.g., decoding audio:
+ *
+ * Load< Sound::Sample > boom(LoadTagParallel, []() -> Sound::Sample const * {
+ *     return new Sound::Sample(data_path("boom.opus"));
+ * });
+ *
+ * (so N files decode in about the time of the slowest one instead of the sum of all of them;
+ *  call_load_functions prints both times, so the difference is easy to check)
+ *
  */
 
+#include <cstdint>
 #include <functional>
 #include <stdexcept>
 
 enum LoadTag : uint32_t {
+	LoadTagParallel, //<-- on worker threads: no OpenGL calls, and must be safe to run at the same time as other loads
 	LoadTagEarly,
 	LoadTagDefault,
 	LoadTagLate,
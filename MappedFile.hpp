@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+//MappedFile maps a whole file read-only into memory; the mapping lasts as long as the object:
+struct MappedFile {
+	MappedFile(std::string const &filename); //throws on error
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	void const *data = nullptr; //(nullptr if the file is empty)
+	size_t size = 0;
+
+private:
+	#if defined(_WIN32)
+	void *file = nullptr; //HANDLE
+	void *mapping = nullptr; //HANDLE
+	#endif
+};
@@ -0,0 +1,126 @@
+#include "MixWorkers.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//helper: keep 'thread' on core 'core' (if the platform supports it; macOS doesn't):
+static void pin_thread(std::thread &thread, uint32_t core) {
+#if defined(_WIN32)
+	if (core < 8 * sizeof(DWORD_PTR)) {
+		SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core);
+	}
+#elif defined(__linux__)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(core, &cpus);
+	if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) != 0) {
+		std::cerr << "WARNING: couldn't pin mixing thread to core " << core << "." << std::endl;
+	}
+#else
+	(void)thread;
+	(void)core;
+#endif
+}
+
+//helper: parts of a ticket:
+static inline uint32_t ticket_run(uint64_t ticket) { return uint32_t(ticket >> 48); }
+static inline uint32_t ticket_chunks(uint64_t ticket) { return uint32_t(ticket >> 32) & 0xffff; }
+static inline uint32_t ticket_next(uint64_t ticket) { return uint32_t(ticket); }
+
+MixWorkers::~MixWorkers() {
+	stop();
+}
+
+void MixWorkers::start(uint32_t count) {
+	stop();
+	quit = false;
+	uint32_t cores = std::max(1U, std::thread::hardware_concurrency());
+	for (uint32_t w = 1; w <= count; ++w) {
+		threads.emplace_back(&MixWorkers::work, this, w);
+		//(leave core 0 for whatever the OS likes to put there)
+		pin_thread(threads.back(), w % cores);
+	}
+}
+
+void MixWorkers::stop() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+}
+
+uint32_t MixWorkers::run(uint32_t chunks, ChunkFunction function_, void *context_, std::chrono::steady_clock::time_point deadline) {
+	assert(chunks < 0x10000);
+	function = function_;
+	context = context_;
+	chunks_done.store(0, std::memory_order_relaxed);
+	run_number = (run_number + 1) & 0xffff;
+	uint64_t const base = (uint64_t(run_number) << 48) | (uint64_t(chunks) << 32);
+	ticket.store(base, std::memory_order_release);
+	//(n.b. a worker that misses this -- because it was just about to sleep -- only misses this run)
+	if (!threads.empty()) wake.notify_all();
+
+	//take chunks here too:
+	uint32_t started = chunks;
+	uint64_t t = ticket.load(std::memory_order_acquire);
+	while (ticket_next(t) < chunks) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			//out of time; claim every chunk that hasn't been started, so nobody starts them:
+			while (!ticket.compare_exchange_weak(t, base | chunks, std::memory_order_acq_rel)) { }
+			started = std::min(ticket_next(t), chunks);
+			break;
+		}
+		if (ticket.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) {
+			function(context, ticket_next(t), 0);
+			chunks_done.fetch_add(1, std::memory_order_release);
+			t = ticket.load(std::memory_order_acquire);
+		}
+	}
+
+	//wait for chunks the workers are still on:
+	while (chunks_done.load(std::memory_order_acquire) < started) {
+		std::this_thread::yield();
+	}
+	return started;
+}
+
+void MixWorkers::work(uint32_t worker) {
+	uint32_t last_run = 0;
+	std::unique_lock< std::mutex > lock(mutex);
+	while (!quit) {
+		//sleep until there's a new run (checking every so often in case a wakeup was missed):
+		wake.wait_for(lock, std::chrono::milliseconds(2), [&](){
+			return quit || ticket_run(ticket.load(std::memory_order_acquire)) != last_run;
+		});
+		if (quit) break;
+		lock.unlock();
+
+		uint64_t t = ticket.load(std::memory_order_acquire);
+		last_run = ticket_run(t);
+		while (ticket_run(t) == last_run && ticket_next(t) < ticket_chunks(t)) {
+			if (ticket.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) {
+				//(the run can't end -- so function and context can't change -- until this chunk is counted as done)
+				function(context, ticket_next(t), worker);
+				chunks_done.fetch_add(1, std::memory_order_release);
+				t = ticket.load(std::memory_order_acquire);
+			}
+		}
+
+		lock.lock();
+	}
+}
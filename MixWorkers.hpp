@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * MixWorkers is a small pool of threads that help the audio callback with
+ * blocks too big for one thread (e.g., thousands of voices).
+ *
+ * The callback splits its work into chunks and calls run(); the calling thread
+ * and the workers then take chunks until none are left. A worker that is slow
+ * to wake up just ends up taking fewer chunks (or none), so the callback never
+ * waits on a thread that hasn't started, only on chunks already being worked on.
+ *
+ * Worker threads are pinned to their own cores where the platform allows, so
+ * the OS doesn't migrate them in the middle of a block.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct MixWorkers {
+	MixWorkers() = default;
+	~MixWorkers();
+	MixWorkers(MixWorkers const &) = delete;
+	MixWorkers &operator=(MixWorkers const &) = delete;
+
+	//do chunk 'chunk' of the current run; 'worker' is 0 for the thread that called run(), 1..count() for pool threads:
+	typedef void (*ChunkFunction)(void *context, uint32_t chunk, uint32_t worker);
+
+	//start 'count' worker threads (call while no run() is in progress):
+	void start(uint32_t count);
+	//stop all worker threads (call while no run() is in progress):
+	void stop();
+	uint32_t count() const { return uint32_t(threads.size()); }
+
+	//do chunks [0, chunks) with the help of the workers, and wait for them to be done.
+	//Once 'deadline' passes, no more chunks are started; returns the number of chunks done
+	// (always the first ones: chunks [returned value, chunks) were skipped):
+	uint32_t run(uint32_t chunks, ChunkFunction function, void *context, std::chrono::steady_clock::time_point deadline);
+
+	//internals:
+	void work(uint32_t worker);
+
+	//everything a participant needs to take a chunk, in one atomic:
+	// (run number) << 48 | (chunk count) << 32 | (next chunk)
+	std::atomic< uint64_t > ticket{0};
+	std::atomic< uint32_t > chunks_done{0};
+	uint32_t run_number = 0;
+	ChunkFunction function = nullptr; //(set before 'ticket' is published)
+	void *context = nullptr;
+
+	std::vector< std::thread > threads;
+	std::mutex mutex; //for sleeping between runs
+	std::condition_variable wake;
+	bool quit = false;
+};
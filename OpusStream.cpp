@@ -0,0 +1,117 @@
+#include "OpusStream.hpp"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+//opus frames are at most 120ms, so a single read returns at most this many samples per channel:
+constexpr uint32_t const MAX_FRAME = 5760;
+
+//the decoder thread and the streams it is responsible for:
+namespace {
+	std::mutex mutex; //protects everything below
+	std::condition_variable wake; //signalled when a stream is added or on shutdown
+	std::vector< std::shared_ptr< OpusStream > > streams;
+	std::thread decoder;
+	bool quit = false;
+
+	void decode_streams() {
+		std::vector< std::shared_ptr< OpusStream > > work;
+		std::unique_lock< std::mutex > lock(mutex);
+		while (!quit) {
+			work.assign(streams.begin(), streams.end());
+			lock.unlock();
+
+			bool busy = false;
+			for (auto const &stream : work) {
+				if (stream->fill()) busy = true;
+			}
+			work.clear(); //(may free streams that were stopped in the meantime)
+
+			lock.lock();
+			//if every buffer was full, wait a bit for playback to catch up:
+			// (a full buffer is over a second of audio, so there's no rush)
+			if (!busy && !quit) wake.wait_for(lock, std::chrono::milliseconds(5));
+		}
+	}
+}
+
+OpusStream::OpusStream(std::string const &filename_, bool loop_) : filename(filename_), loop(loop_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\" for streaming.");
+	}
+	pcm.resize(2 * MAX_FRAME);
+	mono.resize(MAX_FRAME);
+
+	//have enough ready for the first mixing block even if the decoder thread is slow to start:
+	fill(4096);
+}
+
+OpusStream::~OpusStream() {
+	if (op) op_free(op);
+}
+
+bool OpusStream::fill(uint32_t target) {
+	bool decoded = false;
+	while (!finished.load(std::memory_order_relaxed)
+	 && buffer.size() < target
+	 && BufferSize - buffer.size() >= MAX_FRAME) {
+		int ret = op_read_float_stereo(op, pcm.data(), int(pcm.size()));
+		if (ret < 0) {
+			std::cerr << "WARNING: opusfile read error " << ret << " streaming \"" << filename << "\"; stopping stream." << std::endl;
+			finished.store(true, std::memory_order_release);
+		} else if (ret == 0) {
+			//end of file; loop back to the start, unless there was nothing to play in the first place:
+			if (loop && op_pcm_total(op, -1) > 0 && op_pcm_seek(op, 0) == 0) continue;
+			finished.store(true, std::memory_order_release);
+		} else {
+			//downmix to mono by averaging (same as load_opus):
+			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+				mono[i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+			}
+			uint32_t pushed = buffer.push(mono.data(), uint32_t(ret));
+			assert(pushed == uint32_t(ret)); //checked for space above
+			(void)pushed;
+			decoded = true;
+		}
+	}
+	return decoded;
+}
+
+void OpusStream::start(std::shared_ptr< OpusStream > const &stream) {
+	std::unique_lock< std::mutex > lock(mutex);
+	streams.emplace_back(stream);
+	if (!decoder.joinable()) {
+		quit = false;
+		decoder = std::thread(decode_streams);
+	}
+	wake.notify_one();
+}
+
+void OpusStream::stop(OpusStream const *stream) {
+	std::unique_lock< std::mutex > lock(mutex);
+	auto f = std::find_if(streams.begin(), streams.end(), [stream](std::shared_ptr< OpusStream > const &s) {
+		return s.get() == stream;
+	});
+	if (f != streams.end()) streams.erase(f);
+}
+
+void OpusStream::shutdown() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+		wake.notify_one();
+	}
+	if (decoder.joinable()) decoder.join();
+	std::unique_lock< std::mutex > lock(mutex);
+	streams.clear();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * An OpusStream decodes one playing copy of a Sound::Stream.
+ *
+ * Decoding happens on a shared background thread, a little ahead of playback,
+ * into a small ring buffer that the audio callback reads from. So a playing
+ * stream costs the ring buffer plus opusfile's own state, no matter how long
+ * the file is. Looping streams seek back to the start when they run out,
+ * which keeps the loop seamless (the callback just sees more samples).
+ *
+ * Threads: the constructor, start(), and stop() are for the game thread;
+ * 'buffer' and 'finished' are read by the audio callback; everything else
+ * belongs to the decoder thread.
+ */
+
+#include "RingBuffer.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef struct OggOpusFile OggOpusFile;
+
+struct OpusStream {
+	//open 'filename' and decode the first few milliseconds; throws on error:
+	OpusStream(std::string const &filename, bool loop);
+	~OpusStream();
+	OpusStream(OpusStream const &) = delete;
+	OpusStream &operator=(OpusStream const &) = delete;
+
+	//decoded (48kHz, mono) samples waiting to be played; about 1.4 seconds' worth:
+	static constexpr uint32_t const BufferSize = 65536;
+	RingBuffer< float, BufferSize > buffer;
+	//set once the decoder has reached the end (of a non-looping stream) or hit an error;
+	// after that, the stream is over once 'buffer' is empty:
+	std::atomic< bool > finished{false};
+
+	//decode until at least 'target' samples are buffered (or the buffer is nearly full);
+	// returns true if anything was decoded:
+	bool fill(uint32_t target = BufferSize);
+
+	//have the decoder thread keep 'stream' topped up:
+	static void start(std::shared_ptr< OpusStream > const &stream);
+	//stop decoding 'stream' (it will be freed once the decoder thread is done with it):
+	static void stop(OpusStream const *stream);
+	//stop the decoder thread (called by Sound::shutdown):
+	static void shutdown();
+
+	//internals:
+	std::string filename;
+	bool loop;
+	OggOpusFile *op = nullptr;
+	std::vector< float > pcm; //decoded stereo, before downmixing
+	std::vector< float > mono; //downmixed, before copying to 'buffer'
+};
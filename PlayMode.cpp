@@ -40,8 +40,8 @@ Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
 	});
 });
 
-Load< Sound::Sample > dusty_floor_sample(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("dusty-floor.opus"));
+Load< Sound::Stream > dusty_floor_stream(LoadTagParallel, []() -> Sound::Stream const * {
+	return new Sound::Stream(data_path("dusty-floor.opus"));
 });
 
 PlayMode::PlayMode() : scene(*hexapod_scene) {
@@ -65,7 +65,7 @@ PlayMode::PlayMode() : scene(*hexapod_scene) {
 
 	//start music loop playing:
 	// (note: position will be over-ridden in update())
-	leg_tip_loop = Sound::loop_3D(*dusty_floor_sample, 1.0f, get_leg_tip_position(), 10.0f);
+	leg_tip_loop = Sound::loop_3D(*dusty_floor_stream, 1.0f, get_leg_tip_position(), 10.0f);
 }
 
 PlayMode::~PlayMode() {
@@ -151,7 +151,7 @@ void PlayMode::update(float elapsed) {
 	);
 
 	//move sound to follow leg tip position:
-	leg_tip_loop->set_position(get_leg_tip_position(), 1.0f / 60.0f);
+	leg_tip_loop.set_position(get_leg_tip_position(), 1.0f / 60.0f);
 
 	//move camera:
 	{
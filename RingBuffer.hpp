@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//RingBuffer is a fixed-capacity, lock-free queue for exactly one producer thread
+// and one consumer thread (e.g., the game thread and the audio callback).
+// Neither push nor pop ever blocks or allocates.
+
+template< typename T, uint32_t Capacity >
+struct RingBuffer {
+	static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	//producer: add an item; returns false (and does nothing) if the buffer is full:
+	bool push(T const &item) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+		items[h & (Capacity - 1)] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer: remove the oldest item; returns false if the buffer is empty:
+	bool pop(T *item) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == t) return false;
+		*item = items[t & (Capacity - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//producer: add up to 'count' items; returns how many were added:
+	uint32_t push(T const *new_items, uint32_t count) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		uint32_t space = Capacity - (h - tail.load(std::memory_order_acquire));
+		if (count > space) count = space;
+		for (uint32_t n = 0; n < count; ++n) {
+			items[(h + n) & (Capacity - 1)] = new_items[n];
+		}
+		head.store(h + count, std::memory_order_release);
+		return count;
+	}
+
+	//consumer: the oldest items, as one contiguous run that can be read in place
+	// (sets '*count' to its length, which may be less than size() where storage wraps around):
+	T const *peek(uint32_t *count) const {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t waiting = head.load(std::memory_order_acquire) - t;
+		uint32_t to_end = Capacity - (t & (Capacity - 1));
+		*count = (waiting < to_end ? waiting : to_end);
+		return items + (t & (Capacity - 1));
+	}
+
+	//consumer: remove the 'count' oldest items (e.g., after reading them with peek()):
+	void discard(uint32_t count) {
+		tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	//either side: number of items waiting (only a snapshot, of course):
+	uint32_t size() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	//head and tail are on separate cache lines so the two threads don't fight over one line:
+	alignas(64) std::atomic< uint32_t > head{0}; //next slot to write (only written by producer)
+	alignas(64) std::atomic< uint32_t > tail{0}; //next slot to read (only written by consumer)
+	T items[Capacity];
+};
@@ -0,0 +1,426 @@
+#include "SampleCache.hpp"
+
+#include "MappedFile.hpp"
+#include "mix_kernels.hpp"
+#include "load_wav.hpp"
+#include "load_opus.hpp"
+#include "read_write_chunk.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+	//fast 64-bit hash of a block of memory (not cryptographic -- buffers with the same
+	// hash are compared before being shared, and files must also match in size):
+	uint64_t hash_bytes(void const *data_, size_t size) {
+		uint8_t const *data = reinterpret_cast< uint8_t const * >(data_);
+		uint64_t h = 0x9e3779b97f4a7c15ULL ^ uint64_t(size);
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			uint64_t word;
+			std::memcpy(&word, data + i, 8);
+			h ^= word;
+			h *= 0xbf58476d1ce4e5b9ULL;
+			h ^= h >> 31;
+		}
+		if (i < size) {
+			uint64_t word = 0;
+			std::memcpy(&word, data + i, size - i);
+			h ^= word;
+			h *= 0xbf58476d1ce4e5b9ULL;
+			h ^= h >> 31;
+		}
+		//final mix (from MurmurHash3):
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	//what was in a file the last time it was loaded:
+	struct FileInfo {
+		std::uintmax_t size = 0;
+		std::filesystem::file_time_type time;
+		uint64_t hash = 0; //of the file's contents
+	};
+
+	//audio decoded from a file (in whichever formats it has been asked for):
+	struct FileBuffer {
+		std::uintmax_t size = 0; //of the file
+		std::weak_ptr< std::vector< float > const > pcm;
+		std::weak_ptr< std::vector< int16_t > const > int16;
+		std::weak_ptr< std::vector< uint16_t > const > half;
+	};
+
+	//buffers, by hash of their samples:
+	template< typename T >
+	using ByHash = std::unordered_multimap< uint64_t, std::weak_ptr< std::vector< T > const > >;
+
+	//everything below is guarded by 'mutex':
+	std::mutex mutex;
+	std::unordered_map< std::string, FileInfo > by_path;
+	std::unordered_map< uint64_t, FileBuffer > by_file; //by hash of file contents
+	ByHash< float > by_pcm;
+	ByHash< int16_t > by_int16;
+	ByHash< uint16_t > by_half;
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t disk_hits = 0;
+	std::string disk_folder; //(empty if there is no disk cache)
+
+	template< typename T >
+	void sweep(ByHash< T > &by_hash) {
+		for (auto b = by_hash.begin(); b != by_hash.end(); /* later */) {
+			if (b->second.expired()) b = by_hash.erase(b);
+			else ++b;
+		}
+	}
+
+	//forget buffers that are no longer in use (and paths that lead to them):
+	void sweep() {
+		for (auto f = by_file.begin(); f != by_file.end(); /* later */) {
+			if (f->second.pcm.expired() && f->second.int16.expired() && f->second.half.expired()) f = by_file.erase(f);
+			else ++f;
+		}
+		for (auto p = by_path.begin(); p != by_path.end(); /* later */) {
+			if (by_file.count(p->second.hash) == 0) p = by_path.erase(p);
+			else ++p;
+		}
+		sweep(by_pcm);
+		sweep(by_int16);
+		sweep(by_half);
+	}
+
+	//helper: buffer (in the format 'member' holds) decoded from a file with this hash and size, if it's still in use:
+	template< typename T >
+	std::shared_ptr< std::vector< T > const > find_file(uint64_t hash, std::uintmax_t size, std::weak_ptr< std::vector< T > const > FileBuffer::*member) {
+		auto f = by_file.find(hash);
+		if (f == by_file.end() || f->second.size != size) return nullptr;
+		return (f->second.*member).lock();
+	}
+
+	//helper: what 'by_path' knows about a file (only trusted if the file's size and modification time haven't changed):
+	struct PathCheck {
+		bool have_info = false; //could the size and time be read?
+		std::uintmax_t size = 0;
+		std::filesystem::file_time_type time;
+		bool known = false; //...and do they match when it was last loaded?
+		uint64_t hash = 0; //(if so, of its contents)
+	};
+	PathCheck check_path(std::string const &filename) {
+		PathCheck check;
+		std::error_code size_error, time_error;
+		check.size = std::filesystem::file_size(filename, size_error);
+		check.time = std::filesystem::last_write_time(filename, time_error);
+		check.have_info = !size_error && !time_error;
+		if (check.have_info) {
+			std::unique_lock< std::mutex > lock(mutex);
+			auto p = by_path.find(filename);
+			if (p != by_path.end() && p->second.size == check.size && p->second.time == check.time) {
+				check.known = true;
+				check.hash = p->second.hash;
+			}
+		}
+		return check;
+	}
+
+	//Disk cache files are two chunks (see read_write_chunk.hpp):
+	// "pcmh" -- one DiskHeader
+	// "f32 " -- the decoded samples
+	struct DiskHeader {
+		uint32_t version = 0; //DiskVersion when written
+		uint32_t pad = 0;
+		uint64_t file_size = 0; //of the file the samples were decoded from
+		uint64_t file_hash = 0; //...and the hash of its contents
+		uint64_t pcm_hash = 0; //of the samples (to catch damaged cache files)
+	};
+	static_assert(sizeof(DiskHeader) == 32, "DiskHeader is packed");
+
+	//change this whenever decoding changes (e.g., a better resampler), so old cache files are ignored:
+	constexpr uint32_t const DiskVersion = 1;
+
+	std::string disk_path(std::string const &folder, uint64_t hash) {
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+		return folder + "/" + name + ".pcm";
+	}
+
+	//helper: point 'data' and 'size' at the chunk at 'at' (advancing 'at' past it); false if it doesn't fit or has the wrong magic:
+	bool mapped_chunk(uint8_t const *&at, uint8_t const *end, char const *magic, uint8_t const **data, size_t *size) {
+		if (size_t(end - at) < 8 || std::memcmp(at, magic, 4) != 0) return false;
+		uint32_t chunk_size;
+		std::memcpy(&chunk_size, at + 4, 4);
+		if (size_t(end - at) - 8 < chunk_size) return false;
+		*data = at + 8;
+		*size = chunk_size;
+		at += 8 + size_t(chunk_size);
+		return true;
+	}
+
+	//samples decoded from a file with this size and hash, if the disk cache has them (without decoding):
+	std::shared_ptr< std::vector< float > > disk_load(std::string const &folder, uint64_t hash, std::uintmax_t size) {
+		std::string path = disk_path(folder, hash);
+		std::error_code exists_error;
+		if (!std::filesystem::exists(path, exists_error)) return nullptr;
+
+		try {
+			MappedFile file(path);
+			uint8_t const *at = reinterpret_cast< uint8_t const * >(file.data);
+			uint8_t const *end = at + file.size;
+			uint8_t const *header_data, *samples_data;
+			size_t header_size, samples_size;
+			if (!mapped_chunk(at, end, "pcmh", &header_data, &header_size) || header_size != sizeof(DiskHeader)
+			 || !mapped_chunk(at, end, "f32 ", &samples_data, &samples_size) || samples_size % sizeof(float) != 0) {
+				return nullptr;
+			}
+			DiskHeader header;
+			std::memcpy(&header, header_data, sizeof(header));
+			if (header.version != DiskVersion || header.file_size != size || header.file_hash != hash) return nullptr;
+			if (hash_bytes(samples_data, samples_size) != header.pcm_hash) return nullptr;
+
+			//copied out (rather than mixed straight from the mapping) so the audio callback never waits on a page fault:
+			auto data = std::make_shared< std::vector< float > >(samples_size / sizeof(float));
+			if (samples_size) std::memcpy(data->data(), samples_data, samples_size);
+			return data;
+		} catch (std::exception &) {
+			return nullptr;
+		}
+	}
+
+	//write samples decoded from a file with this size and hash to the disk cache; warns on error:
+	void disk_store(std::string const &folder, uint64_t hash, std::uintmax_t size, std::vector< float > const &data) {
+		std::string path = disk_path(folder, hash);
+		//(each thread writes its own temporary file, and the rename replaces the cache file all at once)
+		std::string temp = path + ".tmp" + std::to_string(std::hash< std::thread::id >{}(std::this_thread::get_id()));
+		try {
+			std::error_code folder_error;
+			std::filesystem::create_directories(folder, folder_error);
+
+			std::vector< DiskHeader > header(1);
+			header[0].version = DiskVersion;
+			header[0].file_size = size;
+			header[0].file_hash = hash;
+			header[0].pcm_hash = hash_bytes(data.data(), data.size() * sizeof(float));
+			{
+				std::ofstream out(temp, std::ios::binary);
+				write_chunk("pcmh", header, &out);
+				write_chunk("f32 ", data, &out);
+				if (!out.flush()) throw std::runtime_error("Failed to write '" + temp + "'.");
+			}
+			std::filesystem::rename(temp, path);
+		} catch (std::exception &e) {
+			std::error_code remove_error;
+			std::filesystem::remove(temp, remove_error);
+			std::cerr << "WARNING: couldn't add to the sample cache in '" << folder << "': " << e.what() << std::endl;
+		}
+	}
+}
+
+void SampleCache::set_disk_cache(std::string const &folder) {
+	std::unique_lock< std::mutex > lock(mutex);
+	disk_folder = folder;
+}
+
+namespace {
+	//helper: load 'filename' as SampleCache::load does, also returning the hash and size of the file, and
+	// whether its buffer was already loaded (counting neither as a hit nor as a miss):
+	SampleCache::PCM load_file(std::string const &filename, uint64_t *hash_, std::uintmax_t *size_, bool *hit) {
+		//has this path been loaded before (and not changed since)?
+		PathCheck path = check_path(filename);
+		if (path.known) {
+			std::unique_lock< std::mutex > lock(mutex);
+			if (SampleCache::PCM pcm = find_file(path.hash, path.size, &FileBuffer::pcm)) {
+				*hash_ = path.hash;
+				*size_ = path.size;
+				*hit = true;
+				return pcm;
+			}
+		}
+
+		//does some other loaded file have the same contents?
+		uint64_t hash;
+		std::uintmax_t size;
+		{
+			MappedFile file(filename);
+			hash = hash_bytes(file.data, file.size);
+			size = file.size;
+		}
+		*hash_ = hash;
+		*size_ = size;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			if (path.have_info) by_path[filename] = FileInfo{size, path.time, hash};
+			if (SampleCache::PCM pcm = find_file(hash, size, &FileBuffer::pcm)) {
+				*hit = true;
+				return pcm;
+			}
+		}
+
+		std::string folder;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			folder = disk_folder;
+		}
+
+		//decode (without holding the lock, so other files can be loaded meanwhile) -- unless an earlier run already did:
+		std::shared_ptr< std::vector< float > > data;
+		if (!folder.empty()) data = disk_load(folder, hash, size);
+		bool from_disk = (data != nullptr);
+		if (!from_disk) {
+			data = std::make_shared< std::vector< float > >();
+			if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
+				load_wav(filename, data.get());
+			} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
+				load_opus(filename, data.get());
+			} else {
+				throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".wav\" or \".opus\" -- unsure how to load.");
+			}
+			if (!folder.empty()) disk_store(folder, hash, size, *data);
+		}
+
+		std::unique_lock< std::mutex > lock(mutex);
+		//(another thread may have loaded the same file while this one was decoding)
+		if (SampleCache::PCM pcm = find_file(hash, size, &FileBuffer::pcm)) {
+			*hit = true;
+			return pcm;
+		}
+		*hit = false;
+		if (from_disk) disk_hits += 1;
+		sweep();
+		SampleCache::PCM pcm = data;
+		FileBuffer &buffer = by_file[hash];
+		if (buffer.size != size) buffer = FileBuffer{size};
+		buffer.pcm = pcm;
+		if (path.have_info) by_path[filename] = FileInfo{size, path.time, hash};
+		return pcm;
+	}
+
+	//helper: 'filename' converted to a 16-bit format with 'convert', and kept in 'FileBuffer::*member':
+	template< typename T >
+	std::shared_ptr< std::vector< T > const > load_converted(std::string const &filename, std::weak_ptr< std::vector< T > const > FileBuffer::*member, T (*convert)(float)) {
+		//has this path been loaded (in this format) before, and not changed since?
+		PathCheck path = check_path(filename);
+		if (path.known) {
+			std::unique_lock< std::mutex > lock(mutex);
+			if (auto converted = find_file(path.hash, path.size, member)) {
+				hits += 1;
+				return converted;
+			}
+		}
+
+		//otherwise, convert the floating-point version (which isn't kept, unless something else is using it):
+		uint64_t hash;
+		std::uintmax_t size;
+		bool hit;
+		SampleCache::PCM pcm = load_file(filename, &hash, &size, &hit);
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			//(some other file with the same contents may have been converted already)
+			if (auto converted = find_file(hash, size, member)) {
+				hits += 1;
+				return converted;
+			}
+		}
+		auto data = std::make_shared< std::vector< T > >(pcm->size());
+		for (size_t i = 0; i < pcm->size(); ++i) {
+			(*data)[i] = convert((*pcm)[i]);
+		}
+
+		std::unique_lock< std::mutex > lock(mutex);
+		//(another thread may have converted the same file meanwhile)
+		if (auto converted = find_file(hash, size, member)) {
+			hits += 1;
+			return converted;
+		}
+		misses += 1;
+		std::shared_ptr< std::vector< T > const > converted = data;
+		//('pcm' is still in use, so load_file's entry for it is still here)
+		by_file[hash].*member = converted;
+		return converted;
+	}
+
+	//helper: SampleCache::share for buffers of any format:
+	template< typename T >
+	std::shared_ptr< std::vector< T > const > share_buffer(ByHash< T > &by_hash, std::vector< T > &&data) {
+		uint64_t hash = hash_bytes(data.data(), data.size() * sizeof(T));
+
+		std::unique_lock< std::mutex > lock(mutex);
+		auto range = by_hash.equal_range(hash);
+		for (auto b = range.first; b != range.second; ++b) {
+			std::shared_ptr< std::vector< T > const > buffer = b->second.lock();
+			if (buffer && buffer->size() == data.size()
+			 && std::memcmp(buffer->data(), data.data(), data.size() * sizeof(T)) == 0) {
+				hits += 1;
+				return buffer;
+			}
+		}
+		misses += 1;
+		sweep();
+		std::shared_ptr< std::vector< T > const > buffer = std::make_shared< std::vector< T > const >(std::move(data));
+		by_hash.emplace(hash, buffer);
+		return buffer;
+	}
+}
+
+SampleCache::PCM SampleCache::load(std::string const &filename) {
+	uint64_t hash;
+	std::uintmax_t size;
+	bool hit;
+	PCM pcm = load_file(filename, &hash, &size, &hit);
+
+	std::unique_lock< std::mutex > lock(mutex);
+	if (hit) hits += 1;
+	else misses += 1;
+	return pcm;
+}
+
+SampleCache::PCMInt16 SampleCache::load_int16(std::string const &filename) {
+	return load_converted(filename, &FileBuffer::int16, float_to_int16);
+}
+
+SampleCache::PCMHalf SampleCache::load_half(std::string const &filename) {
+	return load_converted(filename, &FileBuffer::half, float_to_half);
+}
+
+SampleCache::PCM SampleCache::share(std::vector< float > &&data) {
+	return share_buffer(by_pcm, std::move(data));
+}
+
+SampleCache::PCMInt16 SampleCache::share(std::vector< int16_t > &&data) {
+	return share_buffer(by_int16, std::move(data));
+}
+
+SampleCache::PCMHalf SampleCache::share(std::vector< uint16_t > &&data) {
+	return share_buffer(by_half, std::move(data));
+}
+
+SampleCache::Stats SampleCache::stats() {
+	std::unique_lock< std::mutex > lock(mutex);
+	Stats stats;
+	stats.hits = hits;
+	stats.misses = misses;
+	stats.disk_hits = disk_hits;
+	auto count = [&stats](auto const &buffer) {
+		if (!buffer) return;
+		stats.buffers += 1;
+		stats.bytes += buffer->size() * sizeof(buffer->front());
+	};
+	for (auto const &f : by_file) {
+		count(f.second.pcm.lock());
+		count(f.second.int16.lock());
+		count(f.second.half.lock());
+	}
+	for (auto const &b : by_pcm) count(b.second.lock());
+	for (auto const &b : by_int16) count(b.second.lock());
+	for (auto const &b : by_half) count(b.second.lock());
+	return stats;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+//SampleCache shares decoded audio between every Sound::Sample (and playing voice) that uses it:
+// loading the same file twice -- or two files with the same contents -- decodes it only once,
+// and the audio is freed when the last Sample or voice using it lets go.
+//
+//Buffers are immutable once made, so they can be shared between threads without locking.
+//The cache itself is safe to use from several threads at once.
+//
+//Decoded files can also be kept on disk (see set_disk_cache), so later runs skip decoding
+// and resampling entirely and just copy the samples out of a memory-mapped file.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SampleCache {
+	//48kHz, mono, floating-point audio:
+	typedef std::shared_ptr< std::vector< float > const > PCM;
+	//...or the same, in half the memory (see "int16" and "half" in mix_kernels.hpp):
+	typedef std::shared_ptr< std::vector< int16_t > const > PCMInt16;
+	typedef std::shared_ptr< std::vector< uint16_t > const > PCMHalf;
+
+	//decoded contents of a '.wav' or '.opus' file (see load_wav.hpp, load_opus.hpp); throws on error.
+	// Files are recognized by path (if their size and modification time haven't changed since) or else by contents:
+	PCM load(std::string const &filename);
+	//...converted to 16 bits per sample (each file is converted once per format, and the floating-point
+	//   audio isn't kept around, unless something else is using it):
+	PCMInt16 load_int16(std::string const &filename);
+	PCMHalf load_half(std::string const &filename);
+
+	//a buffer holding 'data' (an existing one, if some other buffer already holds the same audio):
+	PCM share(std::vector< float > &&data);
+	PCMInt16 share(std::vector< int16_t > &&data);
+	PCMHalf share(std::vector< uint16_t > &&data);
+
+	//keep decoded files in 'folder' (created if needed) as '<hash of file contents>.pcm';
+	// an empty 'folder' (the default) turns the disk cache off.
+	// Cache files are checked against the file they came from, so stale or damaged ones are just re-decoded;
+	// failing to write one only prints a warning:
+	void set_disk_cache(std::string const &folder);
+
+	//for checking that sharing happens:
+	struct Stats {
+		uint32_t hits = 0; //requests answered with an existing buffer
+		uint32_t misses = 0; //requests that needed a new buffer
+		uint32_t buffers = 0; //buffers still in use
+		size_t bytes = 0; //...and their total size
+		uint32_t disk_hits = 0; //misses answered from the disk cache (without decoding)
+	};
+	Stats stats();
+}
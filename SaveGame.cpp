@@ -0,0 +1,145 @@
+#include "SaveGame.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//helper: write 'bytes' to 'filename' via a temporary file, so the old contents are replaced all at once:
+static void write_file_atomically(std::string const &filename, std::string const &bytes) {
+	std::string temp = filename + ".tmp";
+	FILE *file = std::fopen(temp.c_str(), "wb");
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + temp + "' for writing.");
+	}
+	bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	ok = ok && std::fflush(file) == 0;
+	//make sure the data is on disk before the rename makes it visible:
+	#if defined(_WIN32)
+	ok = ok && _commit(_fileno(file)) == 0;
+	#else
+	ok = ok && fsync(fileno(file)) == 0;
+	#endif
+	ok = (std::fclose(file) == 0) && ok;
+	if (!ok) {
+		std::remove(temp.c_str());
+		throw std::runtime_error("Failed to write '" + temp + "'.");
+	}
+
+	#if defined(_WIN32)
+	//(std::rename won't replace an existing file on windows)
+	ok = MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+	#else
+	ok = std::rename(temp.c_str(), filename.c_str()) == 0;
+	#endif
+	if (!ok) {
+		std::remove(temp.c_str());
+		throw std::runtime_error("Failed to replace '" + filename + "'.");
+	}
+
+	#if !defined(_WIN32)
+	//the rename itself is only on disk once the folder holding the file is (MOVEFILE_WRITE_THROUGH covers this on windows);
+	// until then, a crash could leave the old save -- or, on some filesystems, none at all:
+	size_t slash = filename.rfind('/');
+	std::string folder = (slash == std::string::npos ? "." : (slash == 0 ? "/" : filename.substr(0, slash)));
+	int dir = open(folder.c_str(), O_RDONLY | O_DIRECTORY);
+	if (dir < 0 || fsync(dir) != 0) {
+		//(the new save is in place either way, so this isn't worth failing over)
+		std::cerr << "WARNING: couldn't sync '" << folder << "'; the save might not survive a crash." << std::endl;
+	}
+	if (dir >= 0) close(dir);
+	#endif
+}
+
+void SaveGame::save(std::string const &filename) const {
+	std::vector< Record > record(1);
+	record[0].version = Version;
+	record[0].line_idx = line_idx;
+	record[0].budget = budget;
+	record[0].fan = fan;
+	record[0].coach = coach;
+	record[0].week = week;
+	record[0].focus = focus;
+
+	std::ostringstream out;
+	write_chunk("save", record, &out);
+	write_chunk("brch", std::vector< char >(branch.begin(), branch.end()), &out);
+
+	write_file_atomically(filename, out.str());
+}
+
+bool SaveGame::load(std::string const &filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open()) return false;
+
+	std::vector< Record > record;
+	read_chunk(in, "save", &record);
+	if (record.size() != 1) {
+		throw std::runtime_error("Save '" + filename + "' should hold exactly one record.");
+	}
+	if (record[0].version != Version) {
+		throw std::runtime_error("Save '" + filename + "' has version " + std::to_string(record[0].version) + ", expected " + std::to_string(Version) + ".");
+	}
+	std::vector< char > name;
+	read_chunk(in, "brch", &name);
+
+	branch.assign(name.begin(), name.end());
+	line_idx = record[0].line_idx;
+	budget = record[0].budget;
+	fan = record[0].fan;
+	coach = record[0].coach;
+	week = record[0].week;
+	focus = record[0].focus;
+	return true;
+}
+
+//------------------
+
+AutoSaver::AutoSaver(std::string const &filename_) : filename(filename_), writer([this](){
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		wake.wait(lock, [this](){ return quit || pending; });
+		if (!pending) break; //only quit once everything has been written
+		SaveGame snapshot = std::move(*pending);
+		pending.reset();
+
+		//write without holding the lock, so save() never waits on the disk:
+		lock.unlock();
+		try {
+			snapshot.save(filename);
+		} catch (std::exception const &e) {
+			std::cerr << "WARNING: autosave failed: " << e.what() << std::endl;
+		}
+		lock.lock();
+	}
+}) {
+}
+
+AutoSaver::~AutoSaver() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	writer.join();
+}
+
+void AutoSaver::save(SaveGame const &snapshot) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		pending = snapshot;
+	}
+	wake.notify_one();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * SaveGame is a snapshot of the player's progress through the Story.
+ *
+ * On disk it is a small versioned binary record (see read_write_chunk.hpp):
+ *  |save| chunk holding one SaveGame::Record
+ *  |brch| chunk holding the name of the current branch
+ *
+ * Files are written to a temporary file, flushed to disk, and renamed over
+ * the old save, so a crash mid-write never leaves a truncated save behind.
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+struct SaveGame {
+	std::string branch; //name of the current branch
+	uint32_t line_idx = 0;
+	int32_t budget = 0;
+	int32_t fan = 5;
+	int32_t coach = 5;
+	int32_t week = 1;
+	int32_t focus = 0; //dialog option under the cursor
+
+	//fixed-size part of the on-disk format:
+	struct Record {
+		uint32_t version;
+		uint32_t line_idx;
+		int32_t budget;
+		int32_t fan;
+		int32_t coach;
+		int32_t week;
+		int32_t focus;
+	};
+	static_assert(sizeof(Record) == 28, "Record is packed");
+	static constexpr uint32_t Version = 1;
+
+	//write atomically to 'filename'; throws on error:
+	void save(std::string const &filename) const;
+
+	//read from 'filename'; returns false if there is no such file, throws if it is corrupt:
+	bool load(std::string const &filename);
+};
+
+//AutoSaver writes saves on a background thread, so that the frame never waits on the disk.
+// Only the latest snapshot matters, so a save requested while another is being written
+// replaces any snapshot still waiting in line.
+struct AutoSaver {
+	AutoSaver(std::string const &filename);
+	~AutoSaver(); //writes any pending snapshot before returning
+
+	AutoSaver(AutoSaver const &) = delete;
+	AutoSaver &operator=(AutoSaver const &) = delete;
+
+	void save(SaveGame const &snapshot);
+
+	std::string const filename;
+
+private:
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::optional< SaveGame > pending;
+	bool quit = false;
+	std::thread writer; //declared last so that it starts after the members above are ready
+};
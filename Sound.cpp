@@ -1,27 +1,582 @@
 #include "Sound.hpp"
-#include "load_wav.hpp"
+#include "SoundEffects.hpp"
+#include "HRTF.hpp"
 #include "load_opus.hpp"
+#include "mix_kernels.hpp"
+#include "MixWorkers.hpp"
+#include "OpusStream.hpp"
+#include "SampleCache.hpp"
+
+#include "RingBuffer.hpp"
 
 #include <SDL.h>
+#include <opusfile.h>
+#include <opus.h>
 
-#include <list>
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <functional>
+#include <chrono>
+#include <thread>
 #include <exception>
 #include <iostream>
 #include <algorithm>
+#include <fstream>
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+
+	//Audio is mixed a block at a time; the block size (in frames) is also the audio device's buffer size,
+	// so it sets the output latency (see Sound::set_block_frames). Sizes are powers of two (SDL requires this
+	// of buffer sizes) in [MIN_BLOCK, MAX_BLOCK]; buffers are sized for the largest:
+	constexpr uint32_t const MIN_BLOCK = 128;
+	constexpr uint32_t const MAX_BLOCK = 1024;
+	//(changed only while no callback can be running -- before the device opens, or while it is closed to resize it)
+	uint32_t block_size = MAX_BLOCK;
+	float ramp_step = float(MAX_BLOCK) / float(AUDIO_RATE); //seconds per block (for the ramp helpers)
+	//a block mixed ahead, the end of which is still to be handed to the device (audio callback only; see mix_audio):
+	struct Leftover {
+		float frames[2 * MAX_BLOCK]; //(interleaved left, right)
+		uint32_t begin = 0, end = 0; //(in frames)
+	} leftover;
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//Playing samples ("voices") live in a fixed-size pool, stored as a structure of arrays,
+	// so that the audio callback walks densely packed data and never allocates or frees memory:
+	constexpr uint32_t const MAX_VOICES = 2048;
+
+	//The pool itself belongs to the audio callback; the game thread only ever talks to it through
+	// the command queue below, so neither side has to take a lock:
+	struct VoicePool {
+		//sample data being played:
+		void const *data[MAX_VOICES];
+		Sound::Sample::Storage storage[MAX_VOICES]; //'data' is float (Decoded), int16_t (Int16), or uint16_t (Half)
+		OpusStream *stream[MAX_VOICES]; //if not null, play this instead of 'data'
+		uint32_t decoder[MAX_VOICES]; //if not -1U, play compressed[decoder] instead of 'data'
+		uint32_t size[MAX_VOICES];
+		uint32_t i[MAX_VOICES]; //next data value to read
+		uint32_t frac[MAX_VOICES]; //fractional part of the read position (in 1/2^32's) when resampling
+		bool loop[MAX_VOICES]; //should playback loop after data runs out?
+		bool stopping[MAX_VOICES]; //is playback fading out?
+		uint8_t bus[MAX_VOICES]; //which Sound::Bus the voice is mixed into
+		uint8_t priority[MAX_VOICES]; //(see PlayingSample::set_priority)
+
+		//Voices that can't be heard (or that lose out to louder or more important ones) are "virtual":
+		// they keep their place in the sample but aren't mixed. Voices fade in or out over a block
+		// when they change between mixed and virtual:
+		bool mixed[MAX_VOICES]; //mixed this block?
+		bool was_mixed[MAX_VOICES]; //mixed last block?
+		bool started[MAX_VOICES]; //started since last block?
+
+		//scheduled starts and stops can fall partway through a block (see apply_scheduled):
+		uint32_t start_offset[MAX_VOICES]; //frames of the block being mixed before the voice starts
+		uint32_t stop_offset[MAX_VOICES]; //frame of the block being mixed its fade-out starts at (block_size if none)...
+		float stop_ramp[MAX_VOICES]; //...and how long, in seconds, that fade takes
+
+		Sound::Ramp< float > volume[MAX_VOICES];
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan[MAX_VOICES];
+		//3D playback panning control (unused if sound played in 2D mode), with a separate array for each
+		// component so that the panning of many voices can be computed at once (see pan_3D_voices):
+		float x[MAX_VOICES], y[MAX_VOICES], z[MAX_VOICES];
+		float half_volume_radius[MAX_VOICES];
+		//...the values they are ramping toward, and the time (in seconds) left to get there:
+		float target_x[MAX_VOICES], target_y[MAX_VOICES], target_z[MAX_VOICES];
+		float target_half_volume_radius[MAX_VOICES];
+		float position_ramp[MAX_VOICES];
+		float half_volume_radius_ramp[MAX_VOICES];
+		//...and the gains they give, at the start and end of the block being mixed:
+		float attenuation[MAX_VOICES]; //(at the start, ignoring direction)
+		float start_left[MAX_VOICES], start_right[MAX_VOICES];
+		float end_left[MAX_VOICES], end_right[MAX_VOICES];
+		//in binaural mode, the gains are for a pair of virtual speakers (k and k+1) instead of left and right:
+		uint8_t speaker_pair[MAX_VOICES];
+		//source frames to advance per output frame:
+		Sound::Ramp< float > rate[MAX_VOICES];
+
+		//generation of the voice in each slot (copied from the start command):
+		uint32_t generation[MAX_VOICES] = {};
+		bool playing[MAX_VOICES] = {};
+
+		//slots of voices that are playing (in no particular order):
+		uint32_t active[MAX_VOICES];
+		uint32_t active_count = 0;
+	};
+	VoicePool voices;
+
+	//Voices are mixed into buses, which then go through their effects and volume into the output:
+	constexpr uint32_t const BUS_COUNT = Sound::BusCount;
+
+	//a bus's effects (sent to the audio callback by the game thread, and sent back to be freed when replaced):
+	struct EffectChain {
+		std::vector< std::shared_ptr< Sound::Effect > > effects;
+	};
+
+	//(owned by the audio callback)
+	struct Buses {
+		Buses() {
+			for (auto &v : volume) v.set(1.0f, 0.0f);
+		}
+		Sound::Ramp< float > volume[BUS_COUNT];
+		EffectChain *effects[BUS_COUNT] = {}; //(null if none)
+	};
+	Buses buses;
+
+	//Binaural mode (see Sound::set_binaural): 3D voices are panned between pairs of virtual speakers,
+	// whose feeds are filtered into each bus through their HRIRs (sent to the audio callback by the game
+	// thread, and sent back to be freed when replaced, like EffectChain):
+	struct Binaural {
+		Binaural(std::shared_ptr< HRTF::Set const > const &set_) : set(set_) {
+			for (auto &renderer : renderers) renderer.reset(new HRTF::Renderer(set));
+		}
+		std::shared_ptr< HRTF::Set const > set;
+		std::unique_ptr< HRTF::Renderer > renderers[BUS_COUNT];
+	};
+	Binaural *binaural = nullptr; //(owned by the audio callback; null when not in binaural mode)
+	static_assert(MIN_BLOCK % HRTF::Partition == 0, "HRTF::Renderer takes whole partitions");
+
+	//voices quieter than this (as a gain; about -60dB) are virtual:
+	constexpr float const AUDIBLE_GAIN = 0.001f;
+	//...and only this many voices (by default) are mixed at once; past that, the least important are virtual:
+	constexpr uint32_t const DEFAULT_MIXED_VOICES = 256;
+	uint32_t mixed_voice_limit = DEFAULT_MIXED_VOICES; //(owned by the audio callback)
+
+	//voice counts from the most recent callback:
+	std::atomic< uint32_t > voices_playing_last(0);
+	std::atomic< uint32_t > voices_mixed_last(0);
+
+	//Callback timing (see Sound::CallbackStats); written only by the audio callback, so it needs no
+	// read-modify-write atomics -- just plain loads and stores that the game thread can read at any time:
+	constexpr uint32_t const LOAD_BUCKETS = Sound::CallbackStats::LoadBuckets;
+	struct CallbackTiming {
+		std::atomic< uint32_t > callbacks{0};
+		std::atomic< uint32_t > late{0};
+		std::atomic< uint32_t > overruns{0};
+		std::atomic< float > period{0.0f}; //(of the most recent callback)
+		std::atomic< float > last_load{0.0f};
+		std::atomic< float > peak_load{0.0f};
+		std::atomic< uint32_t > peak_voices{0};
+		std::atomic< uint32_t > counts[LOAD_BUCKETS] = {};
+		std::atomic< uint64_t > voices[LOAD_BUCKETS] = {}; //(summed over the callbacks in each bucket)
+
+		//audio callback only:
+		std::chrono::steady_clock::time_point previous_start;
+		bool have_previous = false; //(false after a reset, or when rendering offline)
+
+		//helper: add one to a counter that only this thread writes:
+		template< typename T >
+		static void bump(std::atomic< T > &counter, T amount = 1) {
+			counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		}
+
+		void reset() {
+			callbacks.store(0, std::memory_order_relaxed);
+			late.store(0, std::memory_order_relaxed);
+			overruns.store(0, std::memory_order_relaxed);
+			last_load.store(0.0f, std::memory_order_relaxed);
+			peak_load.store(0.0f, std::memory_order_relaxed);
+			peak_voices.store(0, std::memory_order_relaxed);
+			for (uint32_t b = 0; b < LOAD_BUCKETS; ++b) {
+				counts[b].store(0, std::memory_order_relaxed);
+				voices[b].store(0, std::memory_order_relaxed);
+			}
+			have_previous = false;
+		}
+	};
+	CallbackTiming timing;
+
+	//Compressed samples are decoded one packet at a time, into a small cache per voice, as they play.
+	// Decoders are big-ish (and can be reset rather than recreated), so only a few voices get one:
+	constexpr uint32_t const MAX_COMPRESSED_VOICES = 64;
+	constexpr uint32_t const MAX_PACKET_SAMPLES = 5760; //120ms, the longest an opus packet can be
+	//...and decoding is capped per voice per callback (at 2.5ms per packet, a block needs at most 10):
+	constexpr uint32_t const MAX_PACKETS_PER_BLOCK = 16;
+
+	struct CompressedVoice {
+		OpusDecoder *decoder = nullptr; //(created by the game thread the first time the slot is handed out)
+		OpusPackets const *packets = nullptr;
+		uint32_t packet = 0; //next packet to decode
+		uint32_t skip = 0; //decoded samples still to drop (the stream's pre-skip)
+		uint32_t remaining = 0; //samples left to play before the end of the stream
+		float cache[MAX_PACKET_SAMPLES]; //most recently decoded packet
+		uint32_t cache_begin = 0; //part of 'cache' not yet played
+		uint32_t cache_end = 0;
+	};
+	CompressedVoice compressed[MAX_COMPRESSED_VOICES];
+
+	//Voices playing at rates other than 1 are resampled with a windowed-sinc filter; playing faster
+	// needs a lower cutoff to avoid aliasing, so there is one filter for each band of rates:
+	constexpr float const MIN_RATE = 1.0f / 16.0f;
+	constexpr float const MAX_RATE = 4.0f;
+	constexpr float const RATE_BANDS[] = { 1.0f, 1.5f, 2.0f, MAX_RATE }; //highest rate for each filter
+	constexpr uint32_t const RATE_BAND_COUNT = sizeof(RATE_BANDS) / sizeof(RATE_BANDS[0]);
+
+	struct ResampleFilters {
+		ResampleFilters() {
+			for (uint32_t b = 0; b < RATE_BAND_COUNT; ++b) {
+				//(cutoff a bit below the output's Nyquist frequency at the band's highest rate)
+				make_resample_filter(0.9f / RATE_BANDS[b], filters[b]);
+			}
+		}
+		//filter for playing at 'rate':
+		float const *for_rate(float rate) const {
+			uint32_t b = 0;
+			while (b + 1 < RATE_BAND_COUNT && rate > RATE_BANDS[b]) ++b;
+			return filters[b];
+		}
+		alignas(64) float filters[RATE_BAND_COUNT][RESAMPLE_PHASES * RESAMPLE_TAPS];
+	};
+	ResampleFilters const resample_filters;
+
+	//decode time of the most recent callback and the slowest callback so far (seconds):
+	std::atomic< float > decode_time_last(0.0f);
+	std::atomic< float > decode_time_peak(0.0f);
+
+	//Slot bookkeeping on the game thread's side: the game thread hands out slots (so play() can
+	// return a handle right away) and gets them back once the audio callback has finished with them:
+	struct VoiceSlots {
+		VoiceSlots() {
+			for (uint32_t v = 0; v < MAX_VOICES; ++v) {
+				free_slots[v] = MAX_VOICES - 1 - v;
+				decoder[v] = -1U;
+			}
+			free_count = MAX_VOICES;
+			for (uint32_t d = 0; d < MAX_COMPRESSED_VOICES; ++d) {
+				free_decoders[d] = MAX_COMPRESSED_VOICES - 1 - d;
+			}
+			free_decoder_count = MAX_COMPRESSED_VOICES;
+		}
+
+		//incremented whenever a slot comes back, so handles to the old voice stop working:
+		uint32_t generation[MAX_VOICES] = {};
+
+		//slots that are available:
+		uint32_t free_slots[MAX_VOICES];
+		uint32_t free_count = 0;
+
+		//decoders for voices playing streams (kept until the slot comes back):
+		std::shared_ptr< OpusStream > streams[MAX_VOICES];
+
+		//decoded audio (in whichever Storage) for voices playing Samples (so it outlives the Sample if need be):
+		std::shared_ptr< void const > pcm[MAX_VOICES];
+
+		//packets (and slot in 'compressed') for voices playing compressed samples:
+		std::shared_ptr< OpusPackets const > packets[MAX_VOICES];
+		uint32_t decoder[MAX_VOICES];
+		uint32_t free_decoders[MAX_COMPRESSED_VOICES];
+		uint32_t free_decoder_count = 0;
+	};
+	VoiceSlots slots;
+
+	//Changes requested by the game thread, applied by the audio callback at the start of each block:
+	struct Command {
+		enum Type : uint8_t {
+			StartVoice,
+			SetVolume,
+			SetPan,
+			SetPosition,
+			SetHalfVolumeRadius,
+			SetRate,
+			SetPriority,
+			StopVoice,
+			StopAll,
+			SetGlobalVolume,
+			SetListener,
+			SetBusVolume,
+			SetBusEffects,
+			SetBinaural,
+			SetMixedVoiceLimit,
+			ResetCallbackStats,
+		} type = StartVoice;
+		bool loop = false; //(StartVoice)
+		uint8_t bus = 0; //(StartVoice, SetBusVolume, SetBusEffects)
+		uint32_t voice = 0; //slot (voice commands only)
+		uint32_t generation = 0; //generation of the voice in that slot (voice commands only)
+		void const *data = nullptr; //(StartVoice)
+		Sound::Sample::Storage storage = Sound::Sample::Decoded; //(StartVoice: how 'data' is stored)
+		OpusStream *stream = nullptr; //(StartVoice, if playing a stream)
+		uint32_t decoder = -1U; //(StartVoice, if playing a compressed sample)
+		OpusPackets const *packets = nullptr; //(StartVoice, if playing a compressed sample)
+		uint32_t size = 0; //(StartVoice; also the limit for SetMixedVoiceLimit)
+		float volume = 0.0f; //(StartVoice, SetVolume, SetGlobalVolume, SetBusVolume)
+		float pan = 0.0f; //(StartVoice, SetPan)
+		glm::vec3 position = glm::vec3(0.0f); //(StartVoice, SetPosition, SetListener)
+		float half_volume_radius = 0.0f; //(StartVoice, SetHalfVolumeRadius)
+		float rate = 1.0f; //(SetRate)
+		uint8_t priority = 0; //(SetPriority)
+		glm::vec3 right = glm::vec3(1.0f, 0.0f, 0.0f); //(SetListener)
+		EffectChain *effects = nullptr; //(SetBusEffects)
+		Binaural *binaural = nullptr; //(SetBinaural)
+		float ramp = 0.0f; //(everything but StartVoice)
+		uint64_t at = 0; //frame of the audio clock to take effect at (StartVoice, StopVoice; 0 means right away)
+	};
+
+	//game thread -> audio callback:
+	RingBuffer< Command, 4096 > commands;
+	//audio callback -> game thread: set when a play_at or stop_at had to happen right away, for lack of room
+	// among the MAX_SCHEDULED waiting (see apply_commands; reported by Sound::update):
+	constexpr uint32_t const MAX_SCHEDULED = 4096;
+	std::atomic< bool > scheduled_overflow(false);
+	//audio callback -> game thread: slots of voices that have finished.
+	// (every slot is in here at most once, so this can never fill up)
+	RingBuffer< uint32_t, MAX_VOICES > retired;
+	//audio callback -> game thread: effect chains that have been replaced (one per SetBusEffects, possibly null):
+	constexpr uint32_t const MAX_CHAINS_IN_FLIGHT = 64;
+	RingBuffer< EffectChain *, MAX_CHAINS_IN_FLIGHT > retired_chains;
+	uint32_t chains_in_flight = 0; //SetBusEffects commands not yet answered in retired_chains (game thread only)
+	//...and the same for binaural filters (one per SetBinaural, possibly null):
+	constexpr uint32_t const MAX_BINAURAL_IN_FLIGHT = 4;
+	RingBuffer< Binaural *, MAX_BINAURAL_IN_FLIGHT > retired_binaural;
+	uint32_t binaural_in_flight = 0; //SetBinaural commands not yet answered in retired_binaural (game thread only)
+
+	//The audio clock: frames mixed before the block being mixed (owned by the audio callback),
+	// and a copy for the game thread (see Sound::audio_time):
+	uint64_t clock_frames = 0;
+	std::atomic< uint64_t > clock_frames_last(0);
+
+	void apply_commands();
+
+	//helper: queue a command for the audio callback (game thread only):
+	void send(Command const &command) {
+		//'commands' has a single producer, and the slot pool (see start_voice) isn't locked,
+		// so every play/set/stop must come from the same thread (the first one to send anything):
+#ifndef NDEBUG
+		static std::thread::id const game_thread = std::this_thread::get_id();
+		assert(std::this_thread::get_id() == game_thread && "Sound's play/set/stop functions are for the game thread only");
+#endif
+		while (!commands.push(command)) {
+			//the callback drains the whole queue every block, so this only happens after
+			// thousands of commands in a single frame; wait for it to catch up:
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		//without an audio device, nothing else will ever read the queue:
+		if (device == 0) apply_commands();
+	}
+
+	//helper: take back slots the audio callback is finished with (game thread only):
+	void reclaim_slots() {
+		uint32_t v;
+		while (retired.pop(&v)) {
+			if (slots.streams[v]) {
+				OpusStream::stop(slots.streams[v].get());
+				slots.streams[v].reset();
+			}
+			if (slots.decoder[v] != -1U) {
+				slots.free_decoders[slots.free_decoder_count++] = slots.decoder[v];
+				slots.decoder[v] = -1U;
+				slots.packets[v].reset();
+			}
+			slots.pcm[v].reset();
+			slots.generation[v] += 1;
+			slots.free_slots[slots.free_count++] = v;
+		}
+	}
+
+	//helper: free effect chains the audio callback is finished with (game thread only):
+	void reclaim_chains() {
+		EffectChain *chain;
+		while (retired_chains.pop(&chain)) {
+			delete chain;
+			chains_in_flight -= 1;
+		}
+	}
+
+	//helper: free binaural filters the audio callback is finished with (game thread only):
+	void reclaim_binaural() {
+		Binaural *old;
+		while (retired_binaural.pop(&old)) {
+			delete old;
+			binaural_in_flight -= 1;
+		}
+	}
+
+	//helper: does 'handle' refer to a voice that the game thread thinks is still playing?
+	bool is_live(Sound::PlayingSample const &handle) {
+		return handle.index < MAX_VOICES && slots.generation[handle.index] == handle.generation;
+	}
+
+	//helper: frame of the audio clock 'time' seconds in:
+	uint64_t clock_frame(double time) {
+		return uint64_t(std::max(0.0, std::round(time * double(AUDIO_RATE))));
+	}
+
+	//helper: make a command addressed to the voice 'handle' refers to:
+	Command voice_command(Command::Type type, Sound::PlayingSample const &handle, float ramp) {
+		Command command;
+		command.type = type;
+		command.voice = handle.index;
+		command.generation = handle.generation;
+		command.ramp = ramp;
+		return command;
+	}
+
+	//helper: is voice 'v' panned in 2D (as opposed to 3D)?
+	bool is_2D(uint32_t v) {
+		return voices.pan[v].value == voices.pan[v].value;
+	}
+
+	//what a voice plays: decoded sample data, a stream, or compressed packets:
+	struct Source {
+		std::shared_ptr< void const > pcm; //(holds on to 'data')
+		void const *data = nullptr;
+		uint32_t size = 0;
+		Sound::Sample::Storage storage = Sound::Sample::Decoded;
+		std::shared_ptr< OpusStream > stream;
+		std::shared_ptr< OpusPackets const > packets;
+	};
+
+	Source source_of(Sound::Sample const &sample) {
+		Source source;
+		auto use = [&source](auto const &pcm, Sound::Sample::Storage storage) {
+			source.pcm = pcm;
+			source.data = pcm->data();
+			source.size = uint32_t(pcm->size());
+			source.storage = storage;
+		};
+		if (sample.data) use(sample.data, Sound::Sample::Decoded);
+		else if (sample.data_int16) use(sample.data_int16, Sound::Sample::Int16);
+		else if (sample.data_half) use(sample.data_half, Sound::Sample::Half);
+		source.packets = sample.packets;
+		return source;
+	}
+
+	//(starts decoding a new copy of 'stream'; has a null stream, with a warning, on failure)
+	Source source_of(Sound::Stream const &stream, bool loop) {
+		Source source;
+		try {
+			source.stream = std::make_shared< OpusStream >(stream.filename, loop);
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: not playing stream: " << e.what() << std::endl;
+		}
+		return source;
+	}
+
+	//helper: warn (once per kind of warning) that a voice couldn't be started:
+	void warn_full(bool *warned, std::string const &message) {
+		if (!*warned) {
+			std::cerr << "WARNING: " << message << std::endl;
+			*warned = true;
+		}
+	}
+
+	//helper: take a slot from the pool and start playing 'source' in it
+	// (at frame 'at' of the audio clock, or right away if 0):
+	Sound::PlayingSample start_voice(Source const &source, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop, Sound::Bus bus, uint64_t at = 0) {
+		Sound::PlayingSample handle;
+		if (!source.stream && !(source.pcm && source.size > 0) && !(source.packets && source.packets->length > 0)) return handle; //nothing to play
+
+		reclaim_slots();
+		if (slots.free_count == 0) {
+			static bool warned = false;
+			warn_full(&warned, "all " + std::to_string(MAX_VOICES) + " voices are in use; ignoring requests to play more samples.");
+			return handle;
+		}
+
+		uint32_t decoder = -1U;
+		if (source.packets) {
+			if (slots.free_decoder_count == 0) {
+				static bool warned = false;
+				warn_full(&warned, "all " + std::to_string(MAX_COMPRESSED_VOICES) + " compressed voices are in use; ignoring requests to play more compressed samples.");
+				return handle;
+			}
+			decoder = slots.free_decoders[slots.free_decoder_count - 1];
+			//(the audio callback isn't using this slot, so it's safe to set up here)
+			if (!compressed[decoder].decoder) {
+				int err = 0;
+				compressed[decoder].decoder = opus_decoder_create(AUDIO_RATE, 1, &err);
+				if (err != OPUS_OK) {
+					compressed[decoder].decoder = nullptr;
+					std::cerr << "WARNING: failed to create opus decoder (error " << err << "); not playing sample." << std::endl;
+					return handle;
+				}
+			}
+			slots.free_decoder_count -= 1;
+		}
+
+		handle.index = slots.free_slots[--slots.free_count];
+		handle.generation = slots.generation[handle.index];
+
+		Command command = voice_command(Command::StartVoice, handle, 0.0f);
+		command.data = source.data;
+		command.size = source.size;
+		command.storage = source.storage;
+		command.stream = source.stream.get();
+		command.decoder = decoder;
+		command.packets = source.packets.get();
+		command.loop = loop;
+		command.bus = uint8_t(bus);
+		command.volume = volume;
+		command.pan = pan;
+		command.position = position;
+		command.half_volume_radius = half_volume_radius;
+		command.at = at;
+		send(command);
+
+		if (source.stream) {
+			slots.streams[handle.index] = source.stream;
+			OpusStream::start(source.stream);
+		}
+		if (source.packets) {
+			slots.packets[handle.index] = source.packets;
+			slots.decoder[handle.index] = decoder;
+		}
+		slots.pcm[handle.index] = source.pcm;
+
+		return handle;
+	}
+
+	//helper: rewind compressed voice 'c' to the start of its sample (audio callback only):
+	void restart_compressed(CompressedVoice &c) {
+		opus_decoder_ctl(c.decoder, OPUS_RESET_STATE);
+		c.packet = 0;
+		c.skip = c.packets->pre_skip;
+		c.remaining = c.packets->length;
+		c.cache_begin = c.cache_end = 0;
+	}
+
+	//helper: decode the next packet of compressed voice 'c' into its cache, looping back to
+	// the start if 'loop' is set; returns false at the end of the sample (audio callback only):
+	bool decode_packet(CompressedVoice &c, bool loop) {
+		OpusPackets const &p = *c.packets;
+		if (c.remaining == 0 || c.packet + 1 >= p.offsets.size()) {
+			if (!loop) return false;
+			restart_compressed(c);
+		}
+		int ret = opus_decode_float(c.decoder,
+			p.data.data() + p.offsets[c.packet], opus_int32(p.offsets[c.packet+1] - p.offsets[c.packet]),
+			c.cache, int(MAX_PACKET_SAMPLES), 0);
+		c.packet += 1;
+		if (ret < 0) {
+			//corrupt packet; treat it as the end of the sample:
+			c.remaining = 0;
+			return false;
+		}
+		uint32_t begin = std::min(c.skip, uint32_t(ret));
+		c.skip -= begin;
+		uint32_t end = begin + std::min(uint32_t(ret) - begin, c.remaining);
+		c.remaining -= end - begin;
+		c.cache_begin = begin;
+		c.cache_end = end;
+		return true;
+	}
+
+	//helper: begin fading out voice 'v' (audio callback only):
+	void stop_voice(uint32_t v, float ramp) {
+		Sound::Ramp< float > &volume = voices.volume[v];
+		if (!voices.stopping[v]) {
+			voices.stopping[v] = true;
+			volume.target = 0.0f;
+			volume.ramp = ramp;
+		} else {
+			volume.ramp = std::min(volume.ramp, ramp);
+		}
+	}
 
 }
 
@@ -36,29 +591,68 @@ Sound::Listener Sound::listener;
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//...as are the threads that help it with big blocks:
+static void start_mix_workers();
+static void stop_mix_workers();
+
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
-	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
-	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+Sound::Sample::Sample(std::string const &filename, Storage storage) {
+	if (storage == Compressed) {
+		if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+			throw std::runtime_error("Sample '" + filename + "' can only be kept compressed if it is an \".opus\" file.");
+		}
+		auto compressed = std::make_shared< OpusPackets >();
+		load_opus_packets(filename, compressed.get());
+		packets = compressed;
+	} else if (storage == Int16) {
+		data_int16 = SampleCache::load_int16(filename);
+	} else if (storage == Half) {
+		data_half = SampleCache::load_half(filename);
 	} else {
-		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
+		data = SampleCache::load(filename);
 	}
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+//helper: keep 'data' in 'storage' (Int16 or Half) in 'sample':
+static void convert_sample(std::vector< float > const &data, Sound::Sample::Storage storage, Sound::Sample *sample) {
+	if (storage == Sound::Sample::Int16) {
+		std::vector< int16_t > converted(data.size());
+		for (size_t i = 0; i < data.size(); ++i) converted[i] = float_to_int16(data[i]);
+		sample->data_int16 = SampleCache::share(std::move(converted));
+	} else if (storage == Sound::Sample::Half) {
+		std::vector< uint16_t > converted(data.size());
+		for (size_t i = 0; i < data.size(); ++i) converted[i] = float_to_half(data[i]);
+		sample->data_half = SampleCache::share(std::move(converted));
+	} else {
+		throw std::runtime_error("Samples made from a buffer can only be kept Decoded, Int16, or Half.");
+	}
 }
 
+Sound::Sample::Sample(std::vector< float > const &data_, Storage storage) {
+	if (storage == Decoded) data = SampleCache::share(std::vector< float >(data_));
+	else convert_sample(data_, storage, this);
+}
 
+Sound::Sample::Sample(std::vector< float > &&data_, Storage storage) {
+	if (storage == Decoded) data = SampleCache::share(std::move(data_));
+	else convert_sample(data_, storage, this);
+}
 
-void Sound::init() {
-	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
-		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
-		std::cerr << "  (Will continue without audio.)\n" << std::endl;
-		return;
+Sound::Stream::Stream(std::string const &filename_) : filename(filename_) {
+	int err = 0;
+	OggOpusFile *op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\" for streaming.");
 	}
+	op_free(op);
+}
+
+
+
+//helper: open the audio device, asking for buffers of block_size frames, and start it playing; returns false on failure:
+static bool open_device() {
+	assert(device == 0);
 
 	//Based on the example on https://wiki.libsdl.org/SDL_OpenAudioDevice
 	SDL_AudioSpec want, have;
@@ -66,16 +660,59 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
+	want.samples = Uint16(block_size);
 	want.callback = mix_audio;
 
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	//(the device may use its own buffer length, since mix_audio can fill any length)
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
+		return false;
+	}
+	if (have.samples != want.samples) {
+		std::cout << "NOTE: audio device uses " << have.samples << "-frame buffers; mixing " << block_size << " frames at a time." << std::endl;
+	}
+
+	//(before any callbacks run)
+	start_mix_workers();
+	//start audio playback:
+	SDL_PauseAudioDevice(device, 0);
+	return true;
+}
+
+//helper: switch to 'frames'-frame blocks (closing and reopening the audio device, if it is open; game thread only):
+static void change_block_size(uint32_t frames) {
+	assert(frames >= MIN_BLOCK && frames <= MAX_BLOCK && (frames & (frames - 1)) == 0);
+	if (frames == block_size) return;
+
+	bool reopen = (device != 0);
+	if (reopen) {
+		//(closing waits for any running callback to finish, and no more start after)
+		SDL_PauseAudioDevice(device, 1);
+		SDL_CloseAudioDevice(device);
+		device = 0;
+	}
+
+	block_size = frames;
+	ramp_step = float(block_size) / float(AUDIO_RATE);
+	leftover.begin = leftover.end = 0; //(a little audio is skipped, along with the glitch of reopening)
+	timing.have_previous = false; //(the gap while the device was closed isn't a late callback)
+
+	if (reopen && !open_device()) {
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+	}
+}
+
+void Sound::init() {
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+		return;
+	}
+
+	if (!open_device()) {
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 	} else {
-		//start audio playback:
-		SDL_PauseAudioDevice(device, 0);
 		std::cout << "Audio output initialized." << std::endl;
 	}
 }
@@ -88,8 +725,177 @@ void Sound::shutdown() {
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+	stop_mix_workers();
+	OpusStream::shutdown();
+}
+
+
+uint32_t Sound::block_frames() {
+	return block_size;
+}
+
+//Adaptive block size (game thread only): blocks double right after a late callback or overrun, and halve
+// after a stretch with none, if no callback in that stretch took more than half its period (so a block half
+// the size would likely have had time to spare). Each time a size turns out too small, the stretch doubles:
+static constexpr float const ADAPT_CALM = 2.0f; //seconds, to start with...
+static constexpr float const ADAPT_CALM_MAX = 120.0f; //...and at most
+static constexpr uint32_t const ADAPT_BUSY_BUCKET = uint32_t(0.5f / Sound::CallbackStats::BucketWidth + 0.5f); //(load of half a period)
+static struct {
+	bool enabled = false;
+	uint32_t min_frames = MIN_BLOCK, max_frames = MAX_BLOCK;
+	float calm = ADAPT_CALM; //seconds without trouble needed before trying a smaller block
+	//callback stats at the start of the current stretch:
+	std::chrono::steady_clock::time_point since;
+	Sound::CallbackStats stats;
+} adaptive;
+
+//helper: start a new stretch of watching the callbacks:
+static void restart_adaptive() {
+	adaptive.since = std::chrono::steady_clock::now();
+	adaptive.stats = Sound::get_callback_stats();
+}
+
+//helper: is 'frames' a block size the mixer supports?
+static bool valid_block_size(uint32_t frames) {
+	return frames >= MIN_BLOCK && frames <= MAX_BLOCK && (frames & (frames - 1)) == 0;
+}
+
+void Sound::set_block_frames(uint32_t frames) {
+	if (!valid_block_size(frames)) {
+		throw std::runtime_error("Block size of " + std::to_string(frames) + " frames isn't one of 128, 256, 512, or 1024.");
+	}
+	adaptive.enabled = false;
+	change_block_size(frames);
+}
+
+void Sound::set_adaptive_block_frames(uint32_t min_frames, uint32_t max_frames) {
+	if (!valid_block_size(min_frames) || !valid_block_size(max_frames) || min_frames > max_frames) {
+		throw std::runtime_error("Adaptive block sizes from " + std::to_string(min_frames) + " to " + std::to_string(max_frames) + " frames aren't an increasing pair of 128, 256, 512, or 1024.");
+	}
+	adaptive.enabled = true;
+	adaptive.min_frames = min_frames;
+	adaptive.max_frames = max_frames;
+	adaptive.calm = ADAPT_CALM;
+	//start from the current size (if it's in range), and let update() work down from there:
+	change_block_size(std::max(min_frames, std::min(max_frames, block_size)));
+	restart_adaptive();
 }
 
+void Sound::update() {
+	//notice samples that have finished (see PlayingSample::playing):
+	reclaim_slots();
+
+	if (scheduled_overflow.load(std::memory_order_relaxed)) {
+		static bool warned = false;
+		warn_full(&warned, "over " + std::to_string(MAX_SCHEDULED) + " play_at and stop_at requests are waiting; playing (or stopping) the rest right away.");
+	}
+
+	if (!adaptive.enabled || device == 0) return;
+
+	CallbackStats stats = get_callback_stats();
+	if (stats.callbacks < adaptive.stats.callbacks) {
+		//stats were reset; start over:
+		restart_adaptive();
+		return;
+	}
+
+	if (stats.late + stats.overruns != adaptive.stats.late + adaptive.stats.overruns) {
+		//trouble (the output likely glitched); grow the block, and wait longer before trying smaller ones again:
+		if (block_size < adaptive.max_frames) {
+			change_block_size(block_size * 2);
+			adaptive.calm = std::min(ADAPT_CALM_MAX, 2.0f * adaptive.calm);
+			std::cout << "Audio callbacks fell behind; now mixing " << block_size << " frames at a time." << std::endl;
+		}
+		restart_adaptive();
+		return;
+	}
+
+	if (std::chrono::duration< float >(std::chrono::steady_clock::now() - adaptive.since).count() < adaptive.calm) return;
+
+	//a calm stretch; was there headroom for a smaller block?
+	uint32_t busy = 0;
+	for (uint32_t b = ADAPT_BUSY_BUCKET; b < CallbackStats::LoadBuckets; ++b) {
+		busy += stats.counts[b] - adaptive.stats.counts[b];
+	}
+	if (busy == 0 && block_size > adaptive.min_frames) {
+		change_block_size(block_size / 2);
+	}
+	restart_adaptive();
+}
+
+//helper: mix one block on the calling thread (used in place of the audio device):
+static void render_block(float *out) {
+	if (device != 0) {
+		throw std::runtime_error("Sound can't render offline while the audio device is open.");
+	}
+	start_mix_workers();
+	//the decoder thread isn't racing a real-time deadline here, so give streams a chance to catch up
+	// rather than letting them skip (keeps renders the same from run to run):
+	for (uint32_t a = 0; a < voices.active_count; ++a) {
+		OpusStream const *stream = voices.stream[voices.active[a]];
+		if (!stream) continue;
+		while (!stream->finished.load(std::memory_order_acquire) && stream->buffer.size() < block_size) {
+			std::this_thread::yield();
+		}
+	}
+	mix_audio(nullptr, reinterpret_cast< Uint8 * >(out), int(block_size * 2 * sizeof(float)));
+}
+
+void Sound::render(uint32_t blocks, std::vector< float > *out_) {
+	assert(out_);
+	auto &out = *out_;
+	size_t start = out.size();
+	out.resize(start + size_t(blocks) * block_size * 2);
+	for (uint32_t b = 0; b < blocks; ++b) {
+		render_block(out.data() + start + size_t(b) * block_size * 2);
+	}
+}
+
+void Sound::render_wav(std::string const &filename, uint32_t blocks) {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+
+	//RIFF/WAVE header for 32-bit float stereo:
+	uint32_t data_bytes = blocks * block_size * 2 * uint32_t(sizeof(float));
+	auto write_u32 = [&file](uint32_t value) { file.write(reinterpret_cast< char const * >(&value), 4); };
+	auto write_u16 = [&file](uint16_t value) { file.write(reinterpret_cast< char const * >(&value), 2); };
+	file.write("RIFF", 4);
+	write_u32(4 + (8 + 18) + (8 + 4) + (8 + data_bytes));
+	file.write("WAVE", 4);
+	file.write("fmt ", 4);
+	write_u32(18);
+	write_u16(3); //WAVE_FORMAT_IEEE_FLOAT
+	write_u16(2); //channels
+	write_u32(AUDIO_RATE);
+	write_u32(AUDIO_RATE * 2 * sizeof(float)); //bytes per second
+	write_u16(2 * sizeof(float)); //bytes per frame
+	write_u16(32); //bits per sample
+	write_u16(0); //no extension
+	file.write("fact", 4);
+	write_u32(4);
+	write_u32(blocks * block_size); //frames
+	file.write("data", 4);
+	write_u32(data_bytes);
+
+	//(n.b. assumes a little-endian machine, as does the rest of the code)
+	std::vector< float > block(block_size * 2);
+	for (uint32_t b = 0; b < blocks; ++b) {
+		render_block(block.data());
+		file.write(reinterpret_cast< char const * >(block.data()), block.size() * sizeof(float));
+	}
+	if (!file) {
+		throw std::runtime_error("Failed to write '" + filename + "'.");
+	}
+}
+
+Sound::DecodeTime Sound::get_decode_time() {
+	DecodeTime time;
+	time.last = decode_time_last.load(std::memory_order_relaxed);
+	time.peak = decode_time_peak.load(std::memory_order_relaxed);
+	return time;
+}
 
 void Sound::lock() {
 	if (device) SDL_LockAudioDevice(device);
@@ -99,110 +905,262 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan, Bus bus) {
+	return start_voice(source_of(sample), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, bus);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_of(sample), volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false, bus);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan, Bus bus) {
+	return start_voice(source_of(sample), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true, bus);
 }
 
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_of(sample), volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true, bus);
+}
+
+Sound::PlayingSample Sound::play(Stream const &stream, float volume, float pan, Bus bus) {
+	return start_voice(source_of(stream, false), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, bus);
+}
 
+Sound::PlayingSample Sound::play_3D(Stream const &stream, float volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_of(stream, false), volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false, bus);
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop(Stream const &stream, float volume, float pan, Bus bus) {
+	return start_voice(source_of(stream, true), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true, bus);
 }
 
+Sound::PlayingSample Sound::loop_3D(Stream const &stream, float volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_of(stream, true), volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true, bus);
+}
+
+Sound::PlayingSample Sound::play_at(Sample const &sample, double time, float volume, float pan, Bus bus) {
+	return start_voice(source_of(sample), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, bus, clock_frame(time));
+}
+
+Sound::PlayingSample Sound::play_3D_at(Sample const &sample, double time, float volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_of(sample), volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false, bus, clock_frame(time));
+}
+
+double Sound::audio_time() {
+	return double(clock_frames_last.load(std::memory_order_relaxed)) / double(AUDIO_RATE);
+}
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	send(command);
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.volume = new_volume;
+	command.ramp = ramp;
+	send(command);
+}
+
+void Sound::set_mixed_voice_limit(uint32_t limit) {
+	Command command;
+	command.type = Command::SetMixedVoiceLimit;
+	command.size = limit;
+	send(command);
+}
+
+Sound::VoiceCounts Sound::get_voice_counts() {
+	VoiceCounts counts;
+	counts.playing = voices_playing_last.load(std::memory_order_relaxed);
+	counts.mixed = voices_mixed_last.load(std::memory_order_relaxed);
+	return counts;
+}
+
+Sound::CallbackStats Sound::get_callback_stats() {
+	CallbackStats stats;
+	stats.period = timing.period.load(std::memory_order_relaxed);
+	stats.callbacks = timing.callbacks.load(std::memory_order_relaxed);
+	stats.late = timing.late.load(std::memory_order_relaxed);
+	stats.overruns = timing.overruns.load(std::memory_order_relaxed);
+	stats.last_load = timing.last_load.load(std::memory_order_relaxed);
+	stats.peak_load = timing.peak_load.load(std::memory_order_relaxed);
+	stats.peak_voices = timing.peak_voices.load(std::memory_order_relaxed);
+	for (uint32_t b = 0; b < LOAD_BUCKETS; ++b) {
+		//(read while the callback may be running, so the counts can be one callback apart from each other)
+		stats.counts[b] = timing.counts[b].load(std::memory_order_relaxed);
+		uint64_t voices = timing.voices[b].load(std::memory_order_relaxed);
+		if (stats.counts[b]) stats.mean_voices[b] = float(double(voices) / double(stats.counts[b]));
+	}
+	return stats;
+}
+
+void Sound::reset_callback_stats() {
+	Command command;
+	command.type = Command::ResetCallbackStats;
+	send(command);
+}
+
+void Sound::dump_callback_stats(std::ostream &to) {
+	CallbackStats stats = get_callback_stats();
+	uint32_t total = 0;
+	for (uint32_t b = 0; b < LOAD_BUCKETS; ++b) {
+		total += stats.counts[b];
+	}
+	//load below which 'fraction' of the callbacks fall (upper edge of the bucket it lands in):
+	auto percentile = [&](float fraction) {
+		uint32_t target = uint32_t(std::ceil(fraction * float(total)));
+		uint32_t seen = 0;
+		for (uint32_t b = 0; b < LOAD_BUCKETS; ++b) {
+			seen += stats.counts[b];
+			if (seen >= target) return float(b + 1) * CallbackStats::BucketWidth;
+		}
+		return float(LOAD_BUCKETS) * CallbackStats::BucketWidth;
+	};
+	auto percent = [](float load) { return std::to_string(int(std::round(load * 100.0f))) + "%"; };
+
+	to << "Audio callbacks: " << stats.callbacks << " of " << (stats.period * 1000.0f) << "ms; "
+		<< stats.late << " late, " << stats.overruns << " overruns." << std::endl;
+	if (total == 0) return;
+	to << "  load: median < " << percent(percentile(0.5f)) << ", 99th percentile < " << percent(percentile(0.99f))
+		<< ", peak " << percent(stats.peak_load) << " (least headroom " << percent(1.0f - stats.peak_load) << ");"
+		<< " most samples playing: " << stats.peak_voices << std::endl;
+	for (uint32_t b = 0; b < LOAD_BUCKETS; ++b) {
+		if (stats.counts[b] == 0) continue;
+		std::string range = percent(float(b) * CallbackStats::BucketWidth) + "-";
+		if (b + 1 < LOAD_BUCKETS) range += percent(float(b + 1) * CallbackStats::BucketWidth);
+		to << "  " << std::string(range.size() < 10 ? 10 - range.size() : 0, ' ') << range
+			<< " " << stats.counts[b] << " callbacks (" << stats.mean_voices[b] << " samples playing on average)" << std::endl;
+	}
+}
+
+void Sound::set_bus_volume(Bus bus, float new_volume, float ramp) {
+	Command command;
+	command.type = Command::SetBusVolume;
+	command.bus = uint8_t(bus);
+	command.volume = new_volume;
+	command.ramp = ramp;
+	send(command);
+}
+
+void Sound::set_bus_effects(Bus bus, std::vector< std::shared_ptr< Effect > > const &effects) {
+	//each replaced chain comes back to be freed here; wait if too many are still on their way:
+	reclaim_chains();
+	while (chains_in_flight == MAX_CHAINS_IN_FLIGHT) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		reclaim_chains();
+	}
+
+	Command command;
+	command.type = Command::SetBusEffects;
+	command.bus = uint8_t(bus);
+	if (!effects.empty()) {
+		command.effects = new EffectChain;
+		command.effects->effects = effects;
+	}
+	chains_in_flight += 1;
+	send(command);
+}
+
+void Sound::set_binaural(std::string const &hrir_file) {
+	//load first, so a bad file throws before anything changes:
+	Binaural *next = nullptr;
+	if (!hrir_file.empty()) {
+		next = new Binaural(std::make_shared< HRTF::Set const >(hrir_file));
+	}
+
+	//the filters being replaced come back to be freed here; wait if too many are still on their way:
+	reclaim_binaural();
+	while (binaural_in_flight == MAX_BINAURAL_IN_FLIGHT) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		reclaim_binaural();
+	}
+
+	Command command;
+	command.type = Command::SetBinaural;
+	command.binaural = next;
+	binaural_in_flight += 1;
+	send(command);
 }
 
 //------------------
+//n.b. the audio callback checks (and ignores) commands for voices that have already finished,
+// and settings that don't apply to a voice's mode; these checks just avoid queueing obvious no-ops:
 
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+	if (!is_live(*this)) return;
+	Command command = voice_command(Command::SetVolume, *this, ramp);
+	command.volume = new_volume;
+	send(command);
 }
 
 void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+	if (!is_live(*this)) return;
+	Command command = voice_command(Command::SetPan, *this, ramp);
+	command.pan = new_pan;
+	send(command);
 }
 
 void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+	if (!is_live(*this)) return;
+	Command command = voice_command(Command::SetPosition, *this, ramp);
+	command.position = new_position;
+	send(command);
 }
 
 void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+	if (!is_live(*this)) return;
+	Command command = voice_command(Command::SetHalfVolumeRadius, *this, ramp);
+	command.half_volume_radius = new_radius;
+	send(command);
+}
+
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) {
+	if (!is_live(*this)) return;
+	Command command = voice_command(Command::SetRate, *this, ramp);
+	command.rate = std::max(MIN_RATE, std::min(MAX_RATE, new_rate));
+	send(command);
+}
+
+void Sound::PlayingSample::set_priority(uint8_t new_priority) {
+	if (!is_live(*this)) return;
+	Command command = voice_command(Command::SetPriority, *this, 0.0f);
+	command.priority = new_priority;
+	send(command);
 }
 
 void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+	if (!is_live(*this)) return;
+	send(voice_command(Command::StopVoice, *this, ramp));
+}
+
+void Sound::PlayingSample::stop_at(double time, float ramp) {
+	if (!is_live(*this)) return;
+	Command command = voice_command(Command::StopVoice, *this, ramp);
+	command.at = clock_frame(time);
+	send(command);
+}
+
+bool Sound::PlayingSample::playing() const {
+	//(finished samples' slots are taken back -- and so stop being live -- in Sound::update, or when another sample starts)
+	return is_live(*this);
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.position = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.right = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.right = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	send(command);
 }
 
 //------------------------ internals --------------------------------
@@ -219,66 +1177,49 @@ inline void compute_pan_weights(float pan, float *left, float *right) {
 	*right = std::sin(ang);
 }
 
-//helper: 3D audio panning
-void compute_pan_from_listener_and_position(
-	glm::vec3 const &listener_position,
-	glm::vec3 const &listener_right,
-	glm::vec3 const &source_position,
-	float source_half_radius,
-	float *left, float *right
-	) {
-	glm::vec3 to = source_position - listener_position;
-	float distance = glm::length(to);
-	//start by panning based on direction.
-	//note that for a LR fade to sound uniform, sound power (squared magnitude) should remain constant.
-	if (distance == 0.0f) {
-		*left = *right = std::sqrt(2.0f);
-	} else {
-		//amt ranges from -1 (most left) to 1 (most right):
-		float amt = glm::dot(listener_right, to) / distance;
-		//turn into an angle from 0.0f (most left) to pi/2 (most right):
-		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
-		*left = std::cos(ang);
-		*right = std::sin(ang);
-
-		//squared distance attenuation is realistic if there are no walls,
-		// but I'm going to use linear because it's sounds better to me.
-		// (feel free to change it, of course)
-		//want att = 0.5f at distance == half_volume_radius
-		float att = 1.0f / (1.0f + (distance / source_half_radius));
-		*left *= att;
-		*right *= att;
-	}
-}
-
-//helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+//helper: ramp updates, a block (of 'ramp_step' seconds) at a time...
 
 //helper: ...for single values:
 void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (ramp_step / ramp.ramp) * (ramp.target - ramp.value);
+		ramp.ramp -= ramp_step;
 	}
 }
 
 //helper: ...for 3D positions:
 void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, ramp_step / ramp.ramp);
+		ramp.ramp -= ramp_step;
 	}
 }
 
+//helper: ...for values kept one component per array (see VoicePool): how far to move toward the target this block
+// (as a fraction; 1.0 means "all the way"), given the seconds left in the ramp (which are counted down):
+float step_ramp_time(float *ramp) {
+	if (*ramp < ramp_step) {
+		*ramp = 0.0f;
+		return 1.0f;
+	} else {
+		float fraction = ramp_step / *ramp;
+		*ramp -= ramp_step;
+		return fraction;
+	}
+}
+inline float ramp_toward(float value, float target, float fraction) {
+	return (fraction >= 1.0f ? target : value + fraction * (target - value));
+}
+
 //helper: ...for 3D directions:
 void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -302,137 +1243,1028 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= (ramp.ramp - ramp_step) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= ramp_step;
 	}
 }
 
 
-//The audio callback -- invoked by SDL when it needs more sound to play:
-void mix_audio(void *, Uint8 *buffer_, int len) {
-	assert(buffer_); //should always have some audio buffer
+namespace {
+	//helpers: start ramping a voice's 3D parameters (like Sound::Ramp::set):
+	void set_voice_position(uint32_t v, glm::vec3 const &position, float ramp) {
+		voices.target_x[v] = position.x;
+		voices.target_y[v] = position.y;
+		voices.target_z[v] = position.z;
+		voices.position_ramp[v] = std::max(0.0f, ramp);
+		if (ramp <= 0.0f) {
+			voices.x[v] = position.x;
+			voices.y[v] = position.y;
+			voices.z[v] = position.z;
+		}
+	}
+	void set_voice_half_volume_radius(uint32_t v, float radius, float ramp) {
+		voices.target_half_volume_radius[v] = radius;
+		voices.half_volume_radius_ramp[v] = std::max(0.0f, ramp);
+		if (ramp <= 0.0f) voices.half_volume_radius[v] = radius;
+	}
+
+	//Commands with a time (StartVoice and StopVoice from play_at and stop_at) wait here until the block they fall in
+	// (audio callback only). The commands stay put in 'scheduled_commands'; a binary heap of small (at, sequence) keys
+	// picks the next one due, so adding or taking one costs O(log n) however they arrive (and ties go in the order sent):
+	struct Scheduled {
+		uint64_t at;
+		uint32_t sequence; //(order sent; compared with wraparound)
+		uint32_t command; //index in scheduled_commands
+	};
+	Command scheduled_commands[MAX_SCHEDULED];
+	uint32_t scheduled_free[MAX_SCHEDULED]; //indices in scheduled_commands that were used and are free again...
+	uint32_t scheduled_free_count = 0;
+	uint32_t scheduled_used = 0; //...and past which none have been used yet
+	Scheduled scheduled[MAX_SCHEDULED]; //(heap, next due at the front)
+	uint32_t scheduled_count = 0;
+	uint32_t scheduled_sequence = 0;
+
+	//(the heap functions keep the *greatest* element in front, so "greater" here means "due sooner")
+	bool due_sooner(Scheduled const &a, Scheduled const &b) {
+		if (a.at != b.at) return a.at > b.at;
+		return int32_t(a.sequence - b.sequence) > 0;
+	}
+
+	void schedule(Command const &command) {
+		assert(scheduled_count < MAX_SCHEDULED);
+		uint32_t index = (scheduled_free_count > 0 ? scheduled_free[--scheduled_free_count] : scheduled_used++);
+		assert(index < MAX_SCHEDULED);
+		scheduled_commands[index] = command;
+		scheduled[scheduled_count++] = Scheduled{command.at, scheduled_sequence++, index};
+		std::push_heap(scheduled, scheduled + scheduled_count, due_sooner);
+	}
+
+	//helper: take the next command due off the heap:
+	Command unschedule_next() {
+		assert(scheduled_count > 0);
+		std::pop_heap(scheduled, scheduled + scheduled_count, due_sooner);
+		uint32_t index = scheduled[--scheduled_count].command;
+		scheduled_free[scheduled_free_count++] = index;
+		return scheduled_commands[index];
+	}
+
+	//helper: hand back the slot of a sample that won't start now:
+	void cancel_start(Command const &command) {
+		if (command.type == Command::StartVoice) {
+			bool returned = retired.push(command.voice);
+			assert(returned && "retired can hold every slot");
+			(void)returned;
+		}
+	}
+
+	//helper: drop scheduled[s] (rare, so it just rebuilds the heap):
+	void cancel_scheduled(uint32_t s) {
+		assert(s < scheduled_count);
+		uint32_t index = scheduled[s].command;
+		cancel_start(scheduled_commands[index]);
+		scheduled_free[scheduled_free_count++] = index;
+		scheduled[s] = scheduled[--scheduled_count];
+		std::make_heap(scheduled, scheduled + scheduled_count, due_sooner);
+	}
+
+	//apply 'command' (a scheduled one 'offset' frames into the block about to be mixed):
+	void apply_command(Command const &command, uint32_t offset) {
+		if (command.type == Command::SetGlobalVolume) {
+			Sound::volume.set(command.volume, command.ramp);
+			return;
+		} else if (command.type == Command::SetListener) {
+			Sound::listener.position.set(command.position, command.ramp);
+			Sound::listener.right.set(command.right, command.ramp);
+			return;
+		} else if (command.type == Command::SetBusVolume) {
+			assert(command.bus < BUS_COUNT);
+			buses.volume[command.bus].set(command.volume, command.ramp);
+			return;
+		} else if (command.type == Command::SetBusEffects) {
+			assert(command.bus < BUS_COUNT);
+			bool returned = retired_chains.push(buses.effects[command.bus]);
+			assert(returned && "game thread never has more chains in flight than retired_chains holds");
+			(void)returned;
+			buses.effects[command.bus] = command.effects;
+			return;
+		} else if (command.type == Command::SetBinaural) {
+			bool returned = retired_binaural.push(binaural);
+			assert(returned && "game thread never has more binaural filters in flight than retired_binaural holds");
+			(void)returned;
+			binaural = command.binaural;
+			return;
+		} else if (command.type == Command::SetMixedVoiceLimit) {
+			mixed_voice_limit = command.size;
+			return;
+		} else if (command.type == Command::ResetCallbackStats) {
+			timing.reset();
+			return;
+		} else if (command.type == Command::StopAll) {
+			for (uint32_t a = 0; a < voices.active_count; ++a) {
+				stop_voice(voices.active[a], command.ramp);
+			}
+			//(samples scheduled to start later never will)
+			while (scheduled_count > 0) {
+				cancel_start(unschedule_next());
+			}
+			return;
+		}
+
+		uint32_t v = command.voice;
+		assert(v < MAX_VOICES);
+		if (command.type == Command::StartVoice) {
+			assert(!voices.playing[v]);
+			voices.data[v] = command.data;
+			voices.storage[v] = command.storage;
+			voices.stream[v] = command.stream;
+			voices.decoder[v] = command.decoder;
+			if (command.decoder != -1U) {
+				compressed[command.decoder].packets = command.packets;
+				restart_compressed(compressed[command.decoder]);
+			}
+			voices.size[v] = command.size;
+			voices.i[v] = 0;
+			voices.frac[v] = 0;
+			voices.rate[v].set(1.0f, 0.0f);
+			voices.loop[v] = command.loop;
+			voices.stopping[v] = false;
+			assert(command.bus < BUS_COUNT);
+			voices.bus[v] = command.bus;
+			voices.priority[v] = 0;
+			voices.started[v] = true;
+			voices.start_offset[v] = offset;
+			voices.stop_offset[v] = block_size;
+			voices.volume[v].set(command.volume, 0.0f);
+			voices.pan[v].set(command.pan, 0.0f);
+			set_voice_position(v, command.position, 0.0f);
+			set_voice_half_volume_radius(v, command.half_volume_radius, 0.0f);
+			voices.generation[v] = command.generation;
+			voices.playing[v] = true;
+			voices.active[voices.active_count++] = v;
+			return;
+		}
+
+		//the voice may have finished since the command was sent:
+		if (!voices.playing[v] || voices.generation[v] != command.generation) {
+			//...or may not have started yet, in which case stopping it means it never will:
+			if (command.type == Command::StopVoice) {
+				for (uint32_t s = 0; s < scheduled_count; ++s) {
+					Command const &start = scheduled_commands[scheduled[s].command];
+					if (start.type == Command::StartVoice && start.voice == v && start.generation == command.generation) {
+						cancel_scheduled(s);
+						break;
+					}
+				}
+			}
+			return;
+		}
+
+		if (command.type == Command::SetVolume) {
+			if (!voices.stopping[v]) voices.volume[v].set(command.volume, command.ramp);
+		} else if (command.type == Command::SetPan) {
+			if (is_2D(v)) voices.pan[v].set(command.pan, command.ramp); //ignore if not in '2D' mode
+		} else if (command.type == Command::SetPosition) {
+			if (!is_2D(v)) set_voice_position(v, command.position, command.ramp); //ignore if not in '3D' mode
+		} else if (command.type == Command::SetHalfVolumeRadius) {
+			if (!is_2D(v)) set_voice_half_volume_radius(v, command.half_volume_radius, command.ramp); //ignore if not in '3D' mode
+		} else if (command.type == Command::SetRate) {
+			voices.rate[v].set(command.rate, command.ramp);
+		} else if (command.type == Command::SetPriority) {
+			voices.priority[v] = command.priority;
+		} else if (command.type == Command::StopVoice) {
+			if (offset == 0 || voices.stopping[v]) {
+				stop_voice(v, command.ramp);
+			} else if (offset < voices.stop_offset[v]) {
+				voices.stop_offset[v] = offset;
+				voices.stop_ramp[v] = command.ramp;
+			}
+		}
+	}
+
+	void apply_commands() {
+		Command command;
+		while (commands.pop(&command)) {
+			//commands for later in the audio clock wait their turn (unless there's no room, in which case they happen now):
+			if (command.at > clock_frames) {
+				if (scheduled_count < MAX_SCHEDULED) {
+					schedule(command);
+					continue;
+				}
+				scheduled_overflow.store(true, std::memory_order_relaxed);
+			}
+			apply_command(command, 0);
+		}
+	}
 
+	//apply the scheduled commands that fall in the block about to be mixed (audio callback only):
+	void apply_scheduled() {
+		while (scheduled_count > 0 && scheduled[0].at < clock_frames + block_size) {
+			Command command = unschedule_next();
+			apply_command(command, uint32_t(std::max(command.at, clock_frames) - clock_frames));
+		}
+	}
+}
+
+//------------------------ mixing --------------------------------
+
+namespace {
+	//one stereo frame of the output buffer:
 	struct LR {
 		float l;
 		float r;
 	};
 	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
-	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
-	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
-		buffer[s].l = 0.0f;
-		buffer[s].r = 0.0f;
+	//global values at the start and end of the block being mixed:
+	struct BlockParams {
+		float start_volume, end_volume;
+		glm::vec3 start_position, end_position;
+		glm::vec3 start_right, end_right;
+	};
+
+	//move voice 'v' along by 'frames' frames (the rest of the block) without mixing it; returns true if it has finished:
+	bool skip_voice(uint32_t v, uint32_t frames) {
+		if (OpusStream *stream = voices.stream[v]) {
+			bool finished = stream->finished.load(std::memory_order_acquire);
+			uint32_t available = stream->buffer.size();
+			stream->buffer.discard(std::min(frames, available));
+			return finished && available <= frames;
+		}
+		assert(voices.decoder[v] == -1U && "compressed voices are always mixed");
+
+		//advance at the same rate that playback would have:
+		float start_rate = voices.rate[v].value;
+		step_value_ramp(voices.rate[v]);
+		float rate = 0.5f * (start_rate + voices.rate[v].value);
+		uint64_t const step = uint64_t(double(rate) * 4294967296.0);
+		uint64_t const end = uint64_t(voices.size[v]) << 32;
+		uint64_t position = ((uint64_t(voices.i[v]) << 32) | voices.frac[v]) + frames * step;
+		if (position >= end) {
+			if (!voices.loop[v]) return true;
+			position %= end;
+		}
+		voices.i[v] = uint32_t(position >> 32);
+		voices.frac[v] = uint32_t(position);
+		return false;
 	}
 
-	//update global values:
-	float start_volume = Sound::volume.value;
-	glm::vec3 start_position =  Sound::listener.position.value;
-	glm::vec3 start_right =  Sound::listener.right.value;
+	//helpers: mix_mono_to_stereo, resample_mono_to_stereo, and reading one value, for 'data' in any Storage:
+	void mix_data(Sound::Sample::Storage storage, void const *data, uint32_t i, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+		if (storage == Sound::Sample::Int16) {
+			mix_int16_to_stereo(static_cast< int16_t const * >(data) + i, count, dst, left, right, left_step, right_step);
+		} else if (storage == Sound::Sample::Half) {
+			mix_half_to_stereo(static_cast< uint16_t const * >(data) + i, count, dst, left, right, left_step, right_step);
+		} else {
+			mix_mono_to_stereo(static_cast< float const * >(data) + i, count, dst, left, right, left_step, right_step);
+		}
+	}
 
-	step_value_ramp(Sound::volume);
-	step_position_ramp( Sound::listener.position);
-	step_direction_ramp( Sound::listener.right);
+	void resample_data(Sound::Sample::Storage storage, void const *data, uint64_t position, uint64_t step, uint32_t count, float const *filter, float *dst, float left, float right, float left_step, float right_step) {
+		if (storage == Sound::Sample::Int16) {
+			resample_int16_to_stereo(static_cast< int16_t const * >(data), position, step, count, filter, dst, left, right, left_step, right_step);
+		} else if (storage == Sound::Sample::Half) {
+			resample_half_to_stereo(static_cast< uint16_t const * >(data), position, step, count, filter, dst, left, right, left_step, right_step);
+		} else {
+			resample_mono_to_stereo(static_cast< float const * >(data), position, step, count, filter, dst, left, right, left_step, right_step);
+		}
+	}
 
-	float end_volume = Sound::volume.value;
-	glm::vec3 end_position =  Sound::listener.position.value;
-	glm::vec3 end_right =  Sound::listener.right.value;
+	float data_value(Sound::Sample::Storage storage, void const *data, uint32_t i) {
+		if (storage == Sound::Sample::Int16) return int16_to_float(static_cast< int16_t const * >(data)[i]);
+		if (storage == Sound::Sample::Half) return half_to_float(static_cast< uint16_t const * >(data)[i]);
+		return static_cast< float const * >(data)[i];
+	}
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	//add frames [first, last) of voice 'v' to 'buffer', with gains 'pan + s * pan_step' at frame s of the block
+	// (resampling at 'rate' if 'resample' is set; adds time spent decoding to '*decode_time');
+	// returns true if the voice ran out:
+	bool mix_frames(uint32_t v, uint32_t first, uint32_t last, LR *buffer, LR pan, LR pan_step, bool resample, float rate, float *decode_time) {
+		bool ended;
+		if (OpusStream *stream = voices.stream[v]) {
+			//check for the end first, so that samples decoded just before it was flagged aren't missed:
+			bool finished = stream->finished.load(std::memory_order_acquire);
+
+			//mix whatever the decoder has ready, in contiguous runs of its buffer:
+			// (if the decoder has fallen behind, the rest of the block is left silent)
+			for (uint32_t s = first; s < last; /* later */) {
+				uint32_t run;
+				float const *data = stream->buffer.peek(&run);
+				run = std::min(run, last - s);
+				if (run == 0) break;
+				mix_mono_to_stereo(data, run, &buffer[s].l,
+					pan.l + s * pan_step.l, pan.r + s * pan_step.r,
+					pan_step.l, pan_step.r);
+				stream->buffer.discard(run);
+				s += run;
+			}
+
+			ended = finished && stream->buffer.size() == 0;
+		} else if (voices.decoder[v] != -1U) {
+			CompressedVoice &c = compressed[voices.decoder[v]];
+			auto before = std::chrono::steady_clock::now();
+
+			//mix from the cache, decoding another packet whenever it runs dry:
+			// (if the cap on decoding is hit, the rest of the block is left silent)
+			ended = false;
+			uint32_t decoded = 0;
+			for (uint32_t s = first; s < last; /* later */) {
+				if (c.cache_begin == c.cache_end) {
+					if (decoded == MAX_PACKETS_PER_BLOCK) break;
+					decoded += 1;
+					if (!decode_packet(c, voices.loop[v])) {
+						ended = true;
+						break;
+					}
+					continue;
+				}
+				uint32_t run = std::min(last - s, c.cache_end - c.cache_begin);
+				mix_mono_to_stereo(c.cache + c.cache_begin, run, &buffer[s].l,
+					pan.l + s * pan_step.l, pan.r + s * pan_step.r,
+					pan_step.l, pan_step.r);
+				c.cache_begin += run;
+				s += run;
+			}
+
+			*decode_time += std::chrono::duration< float >(std::chrono::steady_clock::now() - before).count();
+		} else if (!resample) {
+			void const *data = voices.data[v];
+			Sound::Sample::Storage const storage = voices.storage[v];
+			uint32_t const size = voices.size[v];
+			uint32_t i = voices.i[v];
+			assert(i < size);
+
+			//mix in contiguous runs of sample data (split only where the sample loops):
+			for (uint32_t s = first; s < last; /* later */) {
+				uint32_t run = std::min(last - s, size - i);
+				mix_data(storage, data, i, run, &buffer[s].l,
+					pan.l + s * pan_step.l, pan.r + s * pan_step.r,
+					pan_step.l, pan_step.r);
+				s += run;
+				i += run;
+
+				//update position in sample:
+				if (i == size) {
+					if (voices.loop[v]) {
+						i = 0;
+					} else {
+						break;
+					}
+				}
+			}
+			voices.i[v] = i;
+
+			ended = (i >= size);
+		} else {
+			float const *filter = resample_filters.for_rate(rate);
+
+			void const *data = voices.data[v];
+			Sound::Sample::Storage const storage = voices.storage[v];
+			uint32_t const size = voices.size[v];
+			uint64_t const step = uint64_t(double(rate) * 4294967296.0);
+			uint64_t position = (uint64_t(voices.i[v]) << 32) | voices.frac[v];
+			//(taps run from position - FIRST_TAP to position + LAST_TAP)
+			constexpr uint32_t const FIRST_TAP = RESAMPLE_TAPS / 2 - 1;
+			constexpr uint32_t const LAST_TAP = RESAMPLE_TAPS / 2;
+
+			ended = false;
+			for (uint32_t s = first; s < last; /* later */) {
+				uint32_t i = uint32_t(position >> 32);
+				if (i >= size) {
+					if (voices.loop[v]) {
+						position -= uint64_t(size) << 32;
+						continue;
+					} else {
+						ended = true;
+						break;
+					}
+				}
+
+				if (i >= FIRST_TAP && i + LAST_TAP < size) {
+					//frames whose taps are all inside the sample can go straight to the kernel:
+					uint64_t end = (uint64_t(size - LAST_TAP - 1) << 32) | 0xffffffffULL;
+					uint32_t run = uint32_t(std::min< uint64_t >(last - s, (end - position) / step + 1));
+					resample_data(storage, data, position, step, run, filter, &buffer[s].l,
+						pan.l + s * pan_step.l, pan.r + s * pan_step.r,
+						pan_step.l, pan_step.r);
+					position += run * step;
+					s += run;
+				} else {
+					//near the ends of the sample, gather taps one frame at a time
+					// (wrapping around for looping samples, and padding with silence otherwise):
+					float taps[RESAMPLE_TAPS];
+					for (uint32_t k = 0; k < RESAMPLE_TAPS; ++k) {
+						int64_t j = int64_t(i) + int64_t(k) - int64_t(FIRST_TAP);
+						if (voices.loop[v]) {
+							j %= int64_t(size);
+							if (j < 0) j += size;
+							taps[k] = data_value(storage, data, uint32_t(j));
+						} else {
+							taps[k] = (j >= 0 && j < int64_t(size) ? data_value(storage, data, uint32_t(j)) : 0.0f);
+						}
+					}
+					resample_mono_to_stereo(taps, (uint64_t(FIRST_TAP) << 32) | (position & 0xffffffffULL), step, 1, filter, &buffer[s].l,
+						pan.l + s * pan_step.l, pan.r + s * pan_step.r,
+						pan_step.l, pan_step.r);
+					position += step;
+					s += 1;
+				}
+			}
+
+			voices.i[v] = uint32_t(position >> 32);
+			voices.frac[v] = uint32_t(position);
+		}
+		return ended;
+	}
+
+	//add one block of voice 'v' to 'buffer' (adding time spent decoding to '*decode_time');
+	// returns true if the voice has finished.
+	//Only touches voice 'v' (and its stream or decoder), so different voices can be mixed on different threads:
+	bool mix_voice(uint32_t v, BlockParams const &block, LR *buffer, float *decode_time) {
+		//(a voice that is virtual at the start or end of the block is silent there)
+		bool const was_mixed = voices.was_mixed[v];
+		bool const mixed = voices.mixed[v];
+		voices.was_mixed[v] = mixed;
+
+		//scheduled starts and stops (see apply_scheduled) can fall partway through the block:
+		uint32_t const first = voices.start_offset[v];
+		uint32_t cut = voices.stop_offset[v];
+		voices.start_offset[v] = 0;
+		voices.stop_offset[v] = block_size;
+		if (cut < block_size && !was_mixed && !mixed) {
+			//(can't be heard anyway, so might as well stop at the start of the block)
+			stop_voice(v, voices.stop_ramp[v]);
+			cut = block_size;
+		}
 
 		//Figure out sample panning/volume at start...
-		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&start_pan.l, &start_pan.r);
-
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
+		LR start_pan{0.0f, 0.0f};
+		if (!is_2D(v)) {
+			//3D panning (already computed, along with every other 3D voice's, by pan_3D_voices)
+			if (was_mixed) {
+				start_pan.l = voices.start_left[v];
+				start_pan.r = voices.start_right[v];
+			}
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			if (was_mixed) compute_pan_weights(voices.pan[v].value, &start_pan.l, &start_pan.r);
 
-			step_value_ramp(playing_sample.pan);
+			step_value_ramp(voices.pan[v]);
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		float const start_volume = voices.volume[v].value;
+		start_pan.l *= block.start_volume * start_volume;
+		start_pan.r *= block.start_volume * start_volume;
 
-		step_value_ramp(playing_sample.volume);
+		step_value_ramp(voices.volume[v]);
+
+		if (!was_mixed && !mixed) {
+			//virtual for the whole block; just keep its place:
+			return skip_voice(v, block_size - first)
+			    || (voices.stopping[v] && voices.volume[v].value == 0.0f);
+		}
 
 		//..and end of the mix period:
-		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		LR end_pan{0.0f, 0.0f};
+		if (!mixed) {
+			//(fading out)
+		} else if (!is_2D(v)) {
 			//3D panning
-			compute_pan_from_listener_and_position(
-				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&end_pan.l, &end_pan.r);
+			end_pan.l = voices.end_left[v];
+			end_pan.r = voices.end_right[v];
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			compute_pan_weights(voices.pan[v].value, &end_pan.l, &end_pan.r);
 		}
+		LR const end_direction = end_pan;
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		end_pan.l *= block.end_volume * voices.volume[v].value;
+		end_pan.r *= block.end_volume * voices.volume[v].value;
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
 		LR pan = start_pan;
 		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+		pan_step.l = (end_pan.l - start_pan.l) / block_size;
+		pan_step.r = (end_pan.r - start_pan.r) / block_size;
+
+		//Decoded samples not at their original rate are resampled, with the rate held at its average over the block:
+		bool const resample = (!voices.stream[v] && voices.decoder[v] == -1U)
+			&& !(voices.rate[v].value == 1.0f && voices.rate[v].ramp == 0.0f && voices.frac[v] == 0);
+		float rate = 1.0f;
+		if (resample) {
+			float start_rate = voices.rate[v].value;
+			step_value_ramp(voices.rate[v]);
+			rate = 0.5f * (start_rate + voices.rate[v].value);
+		}
 
-		assert(playing_sample.i < playing_sample.data.size());
+		bool ended = mix_frames(v, first, cut, buffer, pan, pan_step, resample, rate, decode_time);
+
+		if (cut < block_size && !ended) {
+			//scheduled stop: fade out from frame 'cut' on, rather than from the start of the next block:
+			float const t = float(cut) / float(block_size);
+			float const cut_volume = start_volume + t * (voices.volume[v].value - start_volume);
+			float const ramp = voices.stop_ramp[v];
+			uint32_t const ramp_frames = uint32_t(std::max(0.0f, std::round(ramp * float(AUDIO_RATE))));
+			uint32_t fade_end; //(frame of the block the fade is mixed to)
+			voices.stopping[v] = true;
+			voices.volume[v].target = 0.0f;
+			if (ramp_frames <= block_size - cut) {
+				//fade ends in this block:
+				fade_end = cut + ramp_frames;
+				voices.volume[v].value = 0.0f;
+				voices.volume[v].ramp = 0.0f;
+				end_pan = LR{0.0f, 0.0f};
+			} else {
+				//fade continues into later blocks:
+				fade_end = block_size;
+				float const fade = float(block_size - cut) / float(AUDIO_RATE);
+				voices.volume[v].value = cut_volume * (1.0f - fade / ramp);
+				voices.volume[v].ramp = ramp - fade;
+				end_pan.l = end_direction.l * block.end_volume * voices.volume[v].value;
+				end_pan.r = end_direction.r * block.end_volume * voices.volume[v].value;
+			}
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+			if (fade_end > cut) {
+				LR cut_pan;
+				cut_pan.l = pan.l + cut * pan_step.l;
+				cut_pan.r = pan.r + cut * pan_step.r;
+				pan_step.l = (end_pan.l - cut_pan.l) / (fade_end - cut);
+				pan_step.r = (end_pan.r - cut_pan.r) / (fade_end - cut);
+				pan.l = cut_pan.l - cut * pan_step.l;
+				pan.r = cut_pan.r - cut * pan_step.r;
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
+				ended = mix_frames(v, cut, fade_end, buffer, pan, pan_step, resample, rate, decode_time);
+			}
+		}
+
+		return ended
+		    || (voices.stopping[v] && voices.volume[v].value == 0.0f); //sample has finished
+	}
+
+	//move voice 'v' through a block it wasn't mixed in because the mix deadline passed (see MIX_DEADLINE);
+	// it was silent, so, like a virtual voice, it keeps its place and fades back in next block, and a start
+	// or stop scheduled partway through the block happens at its start instead. Returns true if the voice has finished:
+	bool drop_voice(uint32_t v) {
+		uint32_t const first = voices.start_offset[v];
+		voices.was_mixed[v] = false;
+		if (voices.stop_offset[v] < block_size) stop_voice(v, voices.stop_ramp[v]);
+		voices.start_offset[v] = 0;
+		voices.stop_offset[v] = block_size;
+
+		//(3D panning already moved along in pan_3D_voices)
+		if (is_2D(v)) step_value_ramp(voices.pan[v]);
+		step_value_ramp(voices.volume[v]);
+
+		//compressed voices can't skip ahead without decoding, so they pick up where they were:
+		bool skipped_to_end = (voices.decoder[v] == -1U && skip_voice(v, block_size - first));
+		return skipped_to_end
+		    || (voices.stopping[v] && voices.volume[v].value == 0.0f);
+	}
+
+	//3D voices, packed together (one component per array) for the pan kernel:
+	struct Panning {
+		uint32_t voice[MAX_VOICES]; //slot of each
+		alignas(32) float x[MAX_VOICES];
+		alignas(32) float y[MAX_VOICES];
+		alignas(32) float z[MAX_VOICES];
+		alignas(32) float half_volume_radius[MAX_VOICES];
+		alignas(32) float attenuation[MAX_VOICES];
+		alignas(32) float left[MAX_VOICES];
+		alignas(32) float right[MAX_VOICES];
+	} panning;
+
+	//helper: direction of 'to' around a listener whose right is 'right' (with +z up), in radians
+	// clockwise (seen from above) from straight ahead, in [0, 2pi):
+	float listener_azimuth(glm::vec3 const &to, glm::vec3 const &right) {
+		glm::vec3 ahead = glm::cross(glm::vec3(0.0f, 0.0f, 1.0f), right);
+		float azimuth = std::atan2(glm::dot(to, right), glm::dot(to, ahead));
+		return (azimuth < 0.0f ? azimuth + 2.0f * 3.1415926f : azimuth);
+	}
+
+	//helper: first of the two virtual speakers (k and k+1, wrapping around) that 'azimuth' lies between:
+	uint8_t speaker_pair(HRTF::Set const &set, float azimuth) {
+		uint32_t k = set.speakers - 1; //(before the first speaker is between the last and the first)
+		for (uint32_t s = 0; s < set.speakers; ++s) {
+			if (set.azimuths[s] <= azimuth) k = s;
+		}
+		return uint8_t(k);
+	}
+
+	//helper: equal-power gains of virtual speakers k and k+1 for a sound at 'azimuth' (clamped to the pair's edges):
+	void speaker_pair_gains(HRTF::Set const &set, uint32_t k, float azimuth, float gain, float *first, float *second) {
+		float const from = set.azimuths[k];
+		float const span = (k + 1 < set.speakers ? set.azimuths[k + 1] : set.azimuths[0] + 2.0f * 3.1415926f) - from;
+		float offset = azimuth - (from + 0.5f * span); //(from the middle of the pair, wrapped to [-pi, pi])
+		if (offset < -3.1415926f) offset += 2.0f * 3.1415926f;
+		else if (offset > 3.1415926f) offset -= 2.0f * 3.1415926f;
+		float amt = std::max(0.0f, std::min(1.0f, 0.5f + offset / span));
+		*first = std::cos(0.5f * 3.1415926f * amt) * gain;
+		*second = std::sin(0.5f * 3.1415926f * amt) * gain;
+	}
+
+	//compute the start and end gains of every 3D voice for this block, and move their 3D parameters along
+	// by one block; direction and distance are computed several voices at a time (see pan_3D in mix_kernels.hpp),
+	// so this costs a little per voice, instead of a length, divide, sin, and cos (twice) in each mix_voice:
+	void pan_3D_voices(BlockParams const &block) {
+		uint32_t count = 0;
+		for (uint32_t a = 0; a < voices.active_count; ++a) {
+			uint32_t v = voices.active[a];
+			if (is_2D(v)) continue;
+			panning.voice[count] = v;
+			panning.x[count] = voices.x[v];
+			panning.y[count] = voices.y[v];
+			panning.z[count] = voices.z[v];
+			panning.half_volume_radius[count] = voices.half_volume_radius[v];
+			count += 1;
+		}
+		if (count == 0) return;
+
+		//at the start of the block:
+		float const start_position[3] = {block.start_position.x, block.start_position.y, block.start_position.z};
+		float const start_right[3] = {block.start_right.x, block.start_right.y, block.start_right.z};
+		pan_3D(count, panning.x, panning.y, panning.z, panning.half_volume_radius,
+			start_position, start_right, panning.attenuation, panning.left, panning.right);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t v = panning.voice[i];
+			voices.attenuation[v] = panning.attenuation[i];
+			if (binaural) {
+				//(the voice stays on the pair of speakers it starts the block between)
+				HRTF::Set const &set = *binaural->set;
+				float azimuth = listener_azimuth(glm::vec3(voices.x[v], voices.y[v], voices.z[v]) - block.start_position, block.start_right);
+				voices.speaker_pair[v] = speaker_pair(set, azimuth);
+				speaker_pair_gains(set, voices.speaker_pair[v], azimuth, panning.attenuation[i], &voices.start_left[v], &voices.start_right[v]);
+			} else {
+				voices.start_left[v] = panning.left[i];
+				voices.start_right[v] = panning.right[i];
+			}
+
+			float move = step_ramp_time(&voices.position_ramp[v]);
+			voices.x[v] = panning.x[i] = ramp_toward(voices.x[v], voices.target_x[v], move);
+			voices.y[v] = panning.y[i] = ramp_toward(voices.y[v], voices.target_y[v], move);
+			voices.z[v] = panning.z[i] = ramp_toward(voices.z[v], voices.target_z[v], move);
+			move = step_ramp_time(&voices.half_volume_radius_ramp[v]);
+			voices.half_volume_radius[v] = panning.half_volume_radius[i]
+				= ramp_toward(voices.half_volume_radius[v], voices.target_half_volume_radius[v], move);
+		}
+
+		//...and at the end:
+		float const end_position[3] = {block.end_position.x, block.end_position.y, block.end_position.z};
+		float const end_right[3] = {block.end_right.x, block.end_right.y, block.end_right.z};
+		pan_3D(count, panning.x, panning.y, panning.z, panning.half_volume_radius,
+			end_position, end_right, panning.attenuation, panning.left, panning.right);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t v = panning.voice[i];
+			if (binaural) {
+				float azimuth = listener_azimuth(glm::vec3(voices.x[v], voices.y[v], voices.z[v]) - block.end_position, block.end_right);
+				speaker_pair_gains(*binaural->set, voices.speaker_pair[v], azimuth, panning.attenuation[i], &voices.end_left[v], &voices.end_right[v]);
+			} else {
+				voices.end_left[v] = panning.left[i];
+				voices.end_right[v] = panning.right[i];
+			}
+		}
+	}
+
+	//helper: rough gain of voice 'v' at the start of the block (ignoring the direction it's panned):
+	float audibility(uint32_t v, BlockParams const &block) {
+		float gain = block.start_volume * voices.volume[v].value * buses.volume[voices.bus[v]].value;
+		if (!is_2D(v)) {
+			gain *= voices.attenuation[v];
+		}
+		return gain;
+	}
+
+	//decide which active voices are mixed this block (see VoicePool::mixed); returns how many are:
+	uint32_t choose_mixed_voices(BlockParams const &block) {
+		//voices that are loud enough, ranked by priority, then audibility, as (priority, gain bits, slot):
+		// (n.b. positive floats sort the same way as their bits do)
+		static_assert(MAX_VOICES <= (1 << 12), "slot fits in ranking key");
+		static uint64_t ranked[MAX_VOICES];
+		uint32_t count = 0;
+		uint32_t always = 0;
+		for (uint32_t a = 0; a < voices.active_count; ++a) {
+			uint32_t v = voices.active[a];
+			if (voices.decoder[v] != -1U) {
+				//compressed voices can't skip ahead without decoding, so might as well mix them:
+				voices.mixed[v] = true;
+				always += 1;
+			} else {
+				float gain = audibility(v, block);
+				voices.mixed[v] = (gain >= AUDIBLE_GAIN);
+				if (voices.mixed[v]) {
+					uint32_t bits;
+					std::memcpy(&bits, &gain, sizeof(bits));
+					ranked[count++] = (uint64_t(voices.priority[v]) << 44) | (uint64_t(bits) << 12) | v;
 				}
 			}
+			//a voice that has just started doesn't need to fade in (or out, if it was never heard):
+			if (voices.started[v]) {
+				voices.was_mixed[v] = voices.mixed[v];
+				voices.started[v] = false;
+			}
+		}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+		//too many to mix? the least important ones become virtual:
+		if (count > mixed_voice_limit) {
+			std::nth_element(ranked, ranked + mixed_voice_limit, ranked + count, std::greater< uint64_t >());
+			for (uint32_t r = mixed_voice_limit; r < count; ++r) {
+				voices.mixed[ranked[r] & 0xfff] = false;
+			}
+			count = mixed_voice_limit;
 		}
+		return count + always;
+	}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
-		} else {
-			++si;
+	//Blocks with many voices are split into chunks of voices that a few worker threads help mix:
+	constexpr uint32_t const PARALLEL_VOICES = 128; //use the workers from this many mixed voices
+	constexpr uint32_t const CHUNK_VOICES = 32;
+	constexpr uint32_t const MAX_MIX_WORKERS = 3;
+	//stop handing out chunks once this much of the block's time is gone (so the callback returns on time);
+	// voices that miss the cut -- the least important ones, see rank_voices -- are dropped from the block (see drop_voice). Only the audio callback has a
+	// deadline: offline renders (Sound::render, Sound::render_wav) mix every voice, however long it takes:
+	constexpr float const MIX_DEADLINE = 0.75f;
+	MixWorkers workers;
+
+	//Voices are mixed into "targets": target b (< BUS_COUNT) is bus b; in binaural mode, 3D voices instead go to
+	// target BUS_COUNT + b * HRTF::MaxSpeakers + k, bus b's virtual speakers k (as left) and k+1 (as right):
+	constexpr uint32_t const TARGET_COUNT = BUS_COUNT * (1 + HRTF::MaxSpeakers);
+
+	//per-block state shared with the workers:
+	struct Mixing {
+		BlockParams block;
+		LR mix[TARGET_COUNT][MAX_BLOCK]; //the calling thread mixes voices straight into their targets...
+		bool used[TARGET_COUNT] = {}; //(does any voice play into the target this block?)
+		LR scratch[MAX_MIX_WORKERS][TARGET_COUNT][MAX_BLOCK]; //...workers into targets of their own, summed at the end
+		bool scratch_used[MAX_MIX_WORKERS][TARGET_COUNT] = {};
+		float feeds[HRTF::MaxSpeakers][MAX_BLOCK]; //(binaural mode) each virtual speaker's feed for one bus
+		float decode_time[MAX_MIX_WORKERS + 1] = {};
+		uint8_t target[MAX_VOICES] = {}; //by index in voices.active
+		bool ended[MAX_VOICES] = {}; //by index in voices.active
+		uint64_t order[MAX_VOICES]; //(with workers) indices in voices.active, most important first (see rank_voices)
+	} mixing;
+	static_assert(TARGET_COUNT <= 256, "targets fit in Mixing::target");
+
+	//order the active voices for the workers as choose_mixed_voices ranks them (priority, then audibility),
+	// so the chunks left over when the mix deadline passes hold the least important voices;
+	// virtual voices (nothing to mix) go last:
+	void rank_voices(BlockParams const &block) {
+		uint32_t const count = voices.active_count;
+		for (uint32_t a = 0; a < count; ++a) {
+			uint32_t v = voices.active[a];
+			uint64_t key = 0;
+			if (voices.mixed[v]) {
+				float gain = audibility(v, block);
+				uint32_t bits;
+				std::memcpy(&bits, &gain, sizeof(bits));
+				key = (uint64_t(1) << 52) | (uint64_t(voices.priority[v]) << 44) | (uint64_t(bits) << 12);
+			}
+			mixing.order[a] = key | a;
+		}
+		std::sort(mixing.order, mixing.order + count, std::greater< uint64_t >());
+	}
+
+	void mix_chunk(void *, uint32_t chunk, uint32_t worker) {
+		assert(worker <= MAX_MIX_WORKERS);
+		uint32_t end = std::min(voices.active_count, (chunk + 1) * CHUNK_VOICES);
+		for (uint32_t o = chunk * CHUNK_VOICES; o < end; ++o) {
+			uint32_t a = uint32_t(mixing.order[o] & 0xfff);
+			uint32_t v = voices.active[a];
+			uint32_t t = mixing.target[a];
+			LR *buffer = mixing.mix[t];
+			if (worker != 0) {
+				buffer = mixing.scratch[worker-1][t];
+				if (!mixing.scratch_used[worker-1][t]) {
+					std::fill(buffer, buffer + block_size, LR{0.0f, 0.0f});
+					mixing.scratch_used[worker-1][t] = true;
+				}
+			}
+			mixing.ended[a] = mix_voice(v, mixing.block, buffer, &mixing.decode_time[worker]);
+		}
+	}
+}
+
+//(called from the game thread while no callback can be running)
+static void start_mix_workers() {
+	if (workers.count() > 0) return;
+	//leave a core for the game thread and one for the callback itself:
+	uint32_t cores = std::thread::hardware_concurrency();
+	uint32_t count = std::min(MAX_MIX_WORKERS, cores > 2 ? cores - 2 : 0);
+	if (count > 0) workers.start(count);
+}
+
+static void stop_mix_workers() {
+	workers.stop();
+}
+
+//mix the next block (block_size frames) into 'buffer':
+static void mix_block(LR *buffer) {
+	auto block_start = std::chrono::steady_clock::now();
+
+	//pick up play/stop/parameter changes from the game thread (and any it scheduled for this block):
+	apply_commands();
+	apply_scheduled();
+
+	//zero the output buffer:
+	for (uint32_t s = 0; s < block_size; ++s) {
+		buffer[s].l = 0.0f;
+		buffer[s].r = 0.0f;
+	}
+
+	//update global values:
+	BlockParams &block = mixing.block;
+	block.start_volume = Sound::volume.value;
+	block.start_position =  Sound::listener.position.value;
+	block.start_right =  Sound::listener.right.value;
+
+	step_value_ramp(Sound::volume);
+	step_position_ramp( Sound::listener.position);
+	step_direction_ramp( Sound::listener.right);
+
+	block.end_volume = Sound::volume.value;
+	block.end_position =  Sound::listener.position.value;
+	block.end_right =  Sound::listener.right.value;
+
+	uint32_t const count = voices.active_count;
+	pan_3D_voices(block);
+	uint32_t const mixed_count = choose_mixed_voices(block);
+
+	//clear the targets that will be used this block:
+	for (uint32_t t = 0; t < TARGET_COUNT; ++t) {
+		mixing.used[t] = false;
+	}
+	for (uint32_t a = 0; a < count; ++a) {
+		uint32_t v = voices.active[a];
+		uint32_t t = voices.bus[v];
+		if (binaural && !is_2D(v)) t = BUS_COUNT + t * HRTF::MaxSpeakers + voices.speaker_pair[v];
+		mixing.target[a] = uint8_t(t);
+		mixing.used[t] = true;
+	}
+	for (uint32_t t = 0; t < TARGET_COUNT; ++t) {
+		//(effects and binaural filters may have tails to play out)
+		if (mixing.used[t] || (t < BUS_COUNT && (buses.effects[t] || binaural))) {
+			std::fill(mixing.mix[t], mixing.mix[t] + block_size, LR{0.0f, 0.0f});
 		}
 	}
+	voices_playing_last.store(count, std::memory_order_relaxed);
+	voices_mixed_last.store(mixed_count, std::memory_order_relaxed);
 
-	/*//DEBUG: report output power:
-	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
-		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
+	//add audio from each playing voice into its bus:
+	for (uint32_t w = 0; w <= MAX_MIX_WORKERS; ++w) {
+		mixing.decode_time[w] = 0.0f; //(time spent on compressed voices)
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
-	*/
+	if (mixed_count >= PARALLEL_VOICES && workers.count() > 0) {
+		for (uint32_t w = 0; w < MAX_MIX_WORKERS; ++w) {
+			for (uint32_t t = 0; t < TARGET_COUNT; ++t) {
+				mixing.scratch_used[w][t] = false;
+			}
+		}
 
+		//(offline renders -- no device -- never drop voices, so they come out the same from run to run)
+		auto deadline = std::chrono::steady_clock::time_point::max();
+		if (device != 0) {
+			deadline = block_start + std::chrono::duration_cast< std::chrono::steady_clock::duration >(
+				std::chrono::duration< float >(MIX_DEADLINE * float(block_size) / float(AUDIO_RATE)));
+		}
+		rank_voices(block);
+		uint32_t chunks = (count + CHUNK_VOICES - 1) / CHUNK_VOICES;
+		uint32_t done = workers.run(chunks, mix_chunk, nullptr, deadline);
+		for (uint32_t o = done * CHUNK_VOICES; o < count; ++o) {
+			uint32_t a = uint32_t(mixing.order[o] & 0xfff);
+			mixing.ended[a] = drop_voice(voices.active[a]);
+		}
+
+		//sum the workers' targets into the main ones:
+		for (uint32_t w = 0; w < MAX_MIX_WORKERS; ++w) {
+			for (uint32_t t = 0; t < TARGET_COUNT; ++t) {
+				if (!mixing.scratch_used[w][t]) continue;
+				mix_stereo(&mixing.scratch[w][t][0].l, block_size, &mixing.mix[t][0].l, 1.0f, 0.0f);
+			}
+		}
+	} else {
+		for (uint32_t a = 0; a < count; ++a) {
+			uint32_t v = voices.active[a];
+			mixing.ended[a] = mix_voice(v, block, mixing.mix[mixing.target[a]], &mixing.decode_time[0]);
+		}
+	}
+
+	//in binaural mode, filter each bus's virtual speakers into the bus:
+	if (binaural) {
+		uint32_t const speakers = binaural->set->speakers;
+		for (uint32_t b = 0; b < BUS_COUNT; ++b) {
+			//speaker k is the left of pair k and the right of pair k-1:
+			float const *feeds[HRTF::MaxSpeakers] = {};
+			for (uint32_t k = 0; k < speakers; ++k) {
+				uint32_t const as_left = BUS_COUNT + b * HRTF::MaxSpeakers + k;
+				uint32_t const as_right = BUS_COUNT + b * HRTF::MaxSpeakers + (k + speakers - 1) % speakers;
+				if (!mixing.used[as_left] && !mixing.used[as_right]) continue;
+				float *feed = mixing.feeds[k];
+				for (uint32_t s = 0; s < block_size; ++s) {
+					feed[s] = (mixing.used[as_left] ? mixing.mix[as_left][s].l : 0.0f)
+					        + (mixing.used[as_right] ? mixing.mix[as_right][s].r : 0.0f);
+				}
+				feeds[k] = feed;
+			}
+			if (binaural->renderers[b]->process(feeds, block_size, &mixing.mix[b][0].l)) {
+				mixing.used[b] = true;
+			}
+		}
+	}
+
+	//run each bus through its effects, and add it to the output:
+	for (uint32_t b = 0; b < BUS_COUNT; ++b) {
+		float start_gain = buses.volume[b].value;
+		step_value_ramp(buses.volume[b]);
+		float end_gain = buses.volume[b].value;
+
+		if (!mixing.used[b] && !buses.effects[b]) continue;
+		if (EffectChain const *chain = buses.effects[b]) {
+			for (auto const &effect : chain->effects) {
+				effect->process(&mixing.mix[b][0].l, block_size);
+			}
+		}
+		mix_stereo(&mixing.mix[b][0].l, block_size, &buffer[0].l, start_gain, (end_gain - start_gain) / block_size);
+	}
+
+	//hand finished voices' slots back to the game thread (which will invalidate any handles to them):
+	// (walking backward, so the swap-removes only move voices that have already been checked)
+	for (uint32_t a = count; a-- > 0; ) {
+		if (!mixing.ended[a]) continue;
+		uint32_t v = voices.active[a];
+		voices.playing[v] = false;
+		voices.active[a] = voices.active[--voices.active_count];
+		bool returned = retired.push(v);
+		assert(returned && "retired can hold every slot");
+		(void)returned;
+	}
+
+	//the audio clock moves on by a block:
+	clock_frames += block_size;
+	clock_frames_last.store(clock_frames, std::memory_order_relaxed);
+
+	float decode_time = 0.0f;
+	for (uint32_t w = 0; w <= MAX_MIX_WORKERS; ++w) {
+		decode_time += mixing.decode_time[w];
+	}
+	decode_time_last.store(decode_time, std::memory_order_relaxed);
+	if (decode_time > decode_time_peak.load(std::memory_order_relaxed)) {
+		decode_time_peak.store(decode_time, std::memory_order_relaxed);
+	}
+}
+
+//The audio callback -- invoked by SDL when it needs more sound to play:
+void mix_audio(void *, Uint8 *buffer_, int len) {
+	assert(buffer_); //should always have some audio buffer
+	auto callback_start = std::chrono::steady_clock::now();
+
+	assert(len % sizeof(LR) == 0); //should always be whole frames
+	LR *buffer = reinterpret_cast< LR * >(buffer_);
+	uint32_t const frames = uint32_t(len / sizeof(LR));
+
+	//mix whole blocks straight into the buffer; when the device asks for a length that isn't a multiple of the block
+	// size, the part of a block that doesn't fit is kept for the start of the next callback:
+	for (uint32_t done = 0; done < frames; /* later */) {
+		if (leftover.begin == leftover.end) {
+			if (frames - done >= block_size) {
+				mix_block(buffer + done);
+				done += block_size;
+				continue;
+			}
+			mix_block(reinterpret_cast< LR * >(leftover.frames));
+			leftover.begin = 0;
+			leftover.end = block_size;
+		}
+		uint32_t run = std::min(frames - done, leftover.end - leftover.begin);
+		std::copy(leftover.frames + 2 * leftover.begin, leftover.frames + 2 * (leftover.begin + run), &buffer[done].l);
+		leftover.begin += run;
+		done += run;
+	}
+	uint32_t const count = voices_playing_last.load(std::memory_order_relaxed);
+
+	//record how long this callback took (and whether it started late), for get_callback_stats():
+	float const period = float(frames) / float(AUDIO_RATE);
+	timing.period.store(period, std::memory_order_relaxed);
+	float load = std::chrono::duration< float >(std::chrono::steady_clock::now() - callback_start).count() / period;
+	uint32_t bucket = std::min(LOAD_BUCKETS - 1, uint32_t(std::max(0.0f, load) / Sound::CallbackStats::BucketWidth));
+	CallbackTiming::bump(timing.callbacks);
+	CallbackTiming::bump(timing.counts[bucket]);
+	CallbackTiming::bump(timing.voices[bucket], uint64_t(count));
+	timing.last_load.store(load, std::memory_order_relaxed);
+	if (load > timing.peak_load.load(std::memory_order_relaxed)) {
+		timing.peak_load.store(load, std::memory_order_relaxed);
+	}
+	if (count > timing.peak_voices.load(std::memory_order_relaxed)) {
+		timing.peak_voices.store(count, std::memory_order_relaxed);
+	}
+	if (load > 1.0f) CallbackTiming::bump(timing.overruns);
+	//(offline renders aren't paced by a device, so only real callbacks can be late)
+	if (device != 0) {
+		if (timing.have_previous && std::chrono::duration< float >(callback_start - timing.previous_start).count() > 1.5f * period) {
+			CallbackTiming::bump(timing.late);
+		}
+		timing.previous_start = callback_start;
+		timing.have_previous = true;
+	}
 }
 
 
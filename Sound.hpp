@@ -2,29 +2,81 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <limits>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
+struct OpusPackets; //(see load_opus.hpp)
+
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
+	//How a sample keeps its audio in memory:
+	enum Storage {
+		Decoded, //floating point, ready to mix (4 bytes per sample)
+		Int16, //16-bit integers (2 bytes per sample; about 96dB of range below full scale, but anything louder is clipped)
+		Half, //16-bit ("half precision") floating point (2 bytes per sample; about 66dB signal-to-noise at any level)
+		Compressed, //opus packets, decoded while playing (about the size of the file; '.opus' only)
+	};
+
 	//Load from a '.wav' or '.opus' file.
-	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	//  will warn and convert if sound is not already 48kHz mono.
+	//  (several Samples can load at once on different threads -- e.g., from LoadTagParallel loaders, see Load.hpp;
+	//   but only the game thread can play them, see PlayingSample)
+	Sample(std::string const &filename, Storage storage = Decoded);
 	
-	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	//Directly supply an audio buffer (the second version avoids a copy, if kept Decoded; 'storage' can't be Compressed):
+	Sample(std::vector< float > const &data, Storage storage = Decoded);
+	Sample(std::vector< float > &&data, Storage storage = Decoded);
+
+	//sample data is stored as 48kHz, mono, floating-point, in a buffer that never changes once loaded;
+	//  buffers are shared (see SampleCache.hpp), so copies of a Sample, and Samples loaded from the same
+	//  file, cost nothing extra; playing samples hold on to the buffer, so a Sample can be freed while it plays:
+	std::shared_ptr< std::vector< float > const > data;
+
+	//...unless the sample is Int16 or Half, in which case 'data' is null and the audio is in one of these
+	//  (widened to float as it is mixed; see mix_kernels.hpp for the formats). With AVX2 (and F16C), either one
+	//  mixes in about the time float does (resampled Int16, up to 1.2x); without, Int16 takes up to 1.5x as long
+	//  and Half about twice as long (2-3.5x resampled), since SSE2 has no half-float conversion (see mix-bench):
+	std::shared_ptr< std::vector< int16_t > const > data_int16;
+	std::shared_ptr< std::vector< uint16_t > const > data_half;
+
+	//...or Compressed, in which case the audio is here:
+	std::shared_ptr< OpusPackets const > packets;
+};
+
+//Stream objects are long sounds (e.g., music) that are decoded a little at a time as they play,
+//  rather than all at once when loaded: each playing copy keeps about a second of decoded audio
+//  ahead of playback, so memory use doesn't depend on the length of the file.
+//  (play them with the same functions as Samples)
+struct Stream {
+	//Check that a '.opus' file can be streamed (does not decode it); throws on error:
+	Stream(std::string const &filename);
 
-	//sample data is stored as 48kHz, mono, floating-point:
-	std::vector< float > data;
+	std::string filename;
 };
 
+//Every playing sample is mixed into one of these buses ("submixes"), each with its own volume and
+//  chain of effects that is applied to the whole bus at once. So, e.g., the music can be ducked
+//  under dialog, or all the sound effects muffled, without touching each playing sample:
+enum class Bus : uint8_t {
+	SFX, //(the default)
+	Music,
+	Voice,
+	UI,
+};
+constexpr uint32_t const BusCount = 4;
+
+struct Effect; //(see SoundEffects.hpp)
+
 //Ramp<> manages values that should be smoothly interpolated
 //  to a target over a certain amount of time:
 template< typename T >
@@ -48,9 +100,17 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' is a handle to a sample started by one of the play functions below.
+//  None of the play/set/stop functions wait for the audio callback: they queue a command that
+//  the mixer picks up at the start of its next block (so changes are heard within one block).
+//  Handles are small values that can be copied and kept around freely: playing samples live
+//  in a fixed-size pool, and each pool slot counts how many times it has been reused, so a
+//  handle whose sample has finished (even if its slot is now playing something else) does nothing.
+//  Game thread only: the play functions below, PlayingSample's functions, and the other functions that change
+//  what plays (set_volume, set_bus_volume, stop_all_samples, ...) share an unlocked queue and pool, so they must
+//  all be called from the same thread. (Loading Samples is fine on any thread; playing them isn't.)
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
@@ -60,31 +120,27 @@ struct PlayingSample {
 	//set the half-volume radius (use only on "3D" playing sounds):
 	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
 
+	//set the playback rate (2.0 is an octave up and twice as fast, 0.5 an octave down), e.g. for pitch variation or doppler;
+	// clamped to [1/16, 4]; only affects Decoded, Int16, and Half Samples (Streams and Compressed samples always play at 1.0):
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f);
+
+	//when more samples can be heard than the mixer will mix (see set_mixed_voice_limit), higher-priority
+	// samples are mixed first (then louder ones); samples start at priority 0:
+	void set_priority(uint8_t new_priority);
+
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
 	void stop(float ramp = 1.0f / 60.0f);
+	//...or start that fade at exactly 'time' on the audio clock (see Sound::audio_time; past times mean right away).
+	//  (stopping a sample from play_at before it starts means it never will)
+	void stop_at(double time, float ramp = 1.0f / 60.0f);
+
+	//is the sample still playing? (false once it runs out, is stopped, or if it never started);
+	//  finished samples are noticed by Sound::update, so this stays true until the next update after one ends:
+	bool playing() const;
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	uint32_t index = -1U; //slot in the pool of playing samples
+	uint32_t generation = 0; //reuse count of that slot when this sample was started
 };
 
 // ------- global functions -------
@@ -95,54 +151,220 @@ void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  (if too many samples are already playing, the returned handle will be one that does nothing)
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus bus = Bus::SFX
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = Bus::SFX
 );
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus bus = Bus::SFX
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
+	Sample const &sample,
+	float volume,
+	glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = Bus::SFX
+);
+
+//Scheduled versions of 'play' and 'play_3D', which start the sample at exactly 'time' on the audio clock
+//  (see Sound::audio_time) instead of at the start of the next block, for sounds that must land on a beat.
+//  Times already past mean right away; schedule at least a block or two (see block_frames) past
+//  Sound::audio_time() to be on time. Until the sample starts, it counts as playing, but changes
+//  to it (set_volume, etc.) are ignored:
+PlayingSample play_at(
+	Sample const &sample,
+	double time,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	Bus bus = Bus::SFX
+);
+PlayingSample play_3D_at(
 	Sample const &sample,
+	double time,
+	float volume,
+	glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = Bus::SFX
+);
+
+//The audio clock: seconds of audio mixed so far (since Sound::init, or since the first offline render),
+//  that is, the time of the next block the mixer will mix; it moves a block at a time, on the audio thread's schedule:
+double audio_time();
+
+//Streamed versions of the above:
+PlayingSample play(
+	Stream const &stream,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	Bus bus = Bus::SFX
+);
+PlayingSample play_3D(
+	Stream const &stream,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = Bus::SFX
+);
+PlayingSample loop(
+	Stream const &stream,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	Bus bus = Bus::SFX
+);
+PlayingSample loop_3D(
+	Stream const &stream,
+	float volume,
+	glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = Bus::SFX
 );
 
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
 
-	//internals:
+	//internals (owned by the audio callback; change with set_position_right):
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f); //listener's location
 	Ramp< glm::vec3 > right = Ramp< glm::vec3 >(1.0f, 0.0f, 0.0f); //unit vector pointing to listener's right
 };
 extern struct Listener listener;
 
-//"panic button" to shut off all currently playing sounds:
+//"panic button" to shut off all currently playing sounds (and any scheduled to play later):
 void stop_all_samples();
 
 //set global volume:
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
-extern Ramp< float > volume;
+extern Ramp< float > volume; //(owned by the audio callback; change with set_volume)
+
+//Playing samples that are too quiet to hear (about -60dB) are "virtual": they keep their place,
+//  but cost almost nothing because they aren't mixed. At most 'limit' samples (256 by default)
+//  are mixed at once; past that, the lowest-priority and quietest samples are virtual too.
+//  (Compressed samples are always mixed, and don't count toward the limit)
+//With many samples to mix, a few worker threads help, mixing the highest-priority and loudest samples first; if three
+//  quarters of a block's time pass before every sample is mixed, the rest are dropped from that block so the output
+//  stays on time: they are silent for the block but, like virtual samples, keep their place (except Compressed samples,
+//  which pick up where they were) and fade back in; anything scheduled to start or stop partway through the block
+//  (see play_at) happens at its start instead.
+//  (Only the audio device's blocks are dropped from: render and render_wav always mix every sample)
+void set_mixed_voice_limit(uint32_t limit);
+
+//number of samples in the most recent callback that were playing, and that were actually mixed:
+struct VoiceCounts {
+	uint32_t playing = 0;
+	uint32_t mixed = 0;
+};
+VoiceCounts get_voice_counts();
+
+//How long audio callbacks take, to keep an eye on the audio thread (cheap enough to always be on).
+//  A callback's "load" is its duration as a fraction of the block period (the time one block takes to play);
+//  the rest of the period is headroom. When a callback takes longer than the period (an overrun), or starts
+//  well after it should have (late -- e.g., the audio thread wasn't scheduled in time), the output likely glitched:
+struct CallbackStats {
+	static constexpr uint32_t const LoadBuckets = 32;
+	static constexpr float const BucketWidth = 0.05f; //(of load)
+
+	float period = 0.0f; //seconds per block
+	uint32_t callbacks = 0;
+	uint32_t late = 0; //started more than half a period after it was expected (only counted with an audio device)
+	uint32_t overruns = 0; //took longer than a period
+	float last_load = 0.0f; //load of the most recent callback
+	float peak_load = 0.0f; //...and of the slowest one
+	uint32_t peak_voices = 0; //most samples playing in one callback
+
+	//callbacks with load in [b, b+1) * BucketWidth (the last bucket also has everything above):
+	uint32_t counts[LoadBuckets] = {};
+	//average number of samples playing in those callbacks:
+	float mean_voices[LoadBuckets] = {};
+};
+CallbackStats get_callback_stats();
+
+//start counting again from zero (takes effect at the start of the next block):
+void reset_callback_stats();
+
+//print a summary and the load histogram (e.g., at exit):
+void dump_callback_stats(std::ostream &to);
+
+//set the volume of a bus (applied after its effects):
+void set_bus_volume(Bus bus, float new_volume, float ramp = 1.0f / 60.0f);
+
+//replace the effects on a bus; they are applied in order, to the bus's whole mix, every block.
+//  (effects keep state from block to block, so an effect should only be on one bus at a time)
+void set_bus_effects(Bus bus, std::vector< std::shared_ptr< Effect > > const &effects);
+
+//Binaural ("headphone 3D") mode: rather than panning "3D" samples between left and right, filter them through
+//  head-related impulse responses (HRIRs), so that they sound like they come from their direction around
+//  the listener -- including from behind -- on headphones (see HRTF.hpp; dist/hrir.hrir is a set made by make-hrir.py).
+//  Only direction around the listener's head is used (with +z as "up"); distance still sets the volume.
+//  Pass an HRIR file to turn it on (throws if the file can't be loaded), or "" to go back to stereo panning;
+//  filters start empty, so switching while 3D samples play may click:
+void set_binaural(std::string const &hrir_file);
+
+//------- block size (latency) -------
+//The mixer mixes a block of frames at a time; the block size is also the audio device's buffer size, so it sets
+//  how soon a sound that is played is heard: 128, 256, 512, or 1024 frames (about 2.7, 5.3, 11, or 21ms; 1024 by default).
+//  Smaller blocks respond sooner (e.g., for UI sounds), but give the mixer less slack to finish each one on time.
+//  Changing the size reopens the audio device, which may click.
+
+//use 'frames'-frame blocks from now on (and stop adapting); throws if 'frames' isn't one of the sizes above:
+void set_block_frames(uint32_t frames);
+
+//adapt the block size to this machine, between 'min_frames' and 'max_frames' (also sizes from above; throws otherwise):
+//  it starts from the current block size, moved into that range (so from 1024 frames, by default -- a size that is
+//  too small glitches right away, one that is too large only costs latency);
+//  blocks double right after the audio callback falls behind (see CallbackStats), and halve after each two-second
+//  stretch with plenty of headroom, so getting from 1024 down to 256 frames takes at least four seconds;
+//  each time a smaller size doesn't work out, the stretch doubles (up to two minutes) before trying again.
+//  Every change reopens the device (see above), so this is something to opt into, not a default:
+void set_adaptive_block_frames(uint32_t min_frames, uint32_t max_frames = 1024);
+
+//call once per frame (e.g., from main.cpp's loop): takes back finished samples (see PlayingSample::playing),
+//  and in adaptive mode, watches the callbacks and changes the block size:
+void update();
+
+//------- offline rendering -------
+//The mixer can also run without an audio device, as fast as the CPU allows (for tools, tests, and benchmarks).
+// Use these instead of Sound::init(); play/set/stop calls take effect at the start of the next rendered block.
+
+//number of stereo frames in each mixed block (see set_block_frames):
+uint32_t block_frames();
+
+//mix 'blocks' blocks and append them to 'out' as interleaved (left, right) 48kHz floats;
+// throws if the audio device is open:
+void render(uint32_t blocks, std::vector< float > *out);
+
+//mix 'blocks' blocks into a 48kHz stereo 32-bit float '.wav' file; throws on error (or if the audio device is open):
+void render_wav(std::string const &filename, uint32_t blocks);
+
+//time spent decoding Compressed samples in the audio callback, in seconds:
+// (each compressed voice decodes at most a few packets per callback, and only 64
+//  compressed voices can play at once, so this stays bounded; it's measured to make sure)
+struct DecodeTime {
+	float last = 0.0f; //in the most recent callback
+	float peak = 0.0f; //in the slowest callback so far
+};
+DecodeTime get_decode_time();
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions don't need these (they go through a lock-free command queue),
+// so you shouldn't need to call them unless your code is reading or modifying internals directly:
 void lock();
 void unlock();
 
@@ -0,0 +1,396 @@
+#include "SoundEffects.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+//SSE2 is part of every x86-64 CPU, so no need to check at runtime:
+#define SOUND_EFFECTS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//same as the mixer:
+static constexpr float const SAMPLE_RATE = 48000.0f;
+
+//recursive filters that are fed silence decay into denormal numbers, which are very slow on most CPUs;
+// state smaller than this is inaudible, so it gets flushed to zero at the end of each block:
+static constexpr float const DENORMAL_LIMIT = 1.0e-15f;
+static inline float flush(float x) {
+	return (std::abs(x) < DENORMAL_LIMIT ? 0.0f : x);
+}
+
+static inline float db_to_gain(float db) {
+	return std::pow(10.0f, db / 20.0f);
+}
+
+//------------------------ Biquad --------------------------------
+
+Sound::Biquad::Biquad(Type type_, float frequency_, float q_, float gain_db_) {
+	set(type_, frequency_, q_, gain_db_);
+}
+
+void Sound::Biquad::set(Type type_, float frequency_, float q_, float gain_db_) {
+	type.store(type_, std::memory_order_relaxed);
+	frequency.store(frequency_, std::memory_order_relaxed);
+	q.store(q_, std::memory_order_relaxed);
+	gain_db.store(gain_db_, std::memory_order_relaxed);
+	parameters_changed();
+}
+
+void Sound::Biquad::process(float *frames, uint32_t count) {
+	if (check_parameters()) {
+		//from "Cookbook formulae for audio EQ biquad filter coefficients" by Robert Bristow-Johnson:
+		constexpr float const Pi = 3.14159265358979323846f;
+		float f = std::max(10.0f, std::min(0.49f * SAMPLE_RATE, frequency.load(std::memory_order_relaxed)));
+		float w0 = 2.0f * Pi * f / SAMPLE_RATE;
+		float cosw = std::cos(w0);
+		float alpha = std::sin(w0) / (2.0f * std::max(0.01f, q.load(std::memory_order_relaxed)));
+		float A = std::pow(10.0f, gain_db.load(std::memory_order_relaxed) / 40.0f);
+		float sqA2alpha = 2.0f * std::sqrt(A) * alpha;
+
+		float B0 = 1.0f, B1 = 0.0f, B2 = 0.0f, A0 = 1.0f, A1 = 0.0f, A2 = 0.0f;
+		switch (type.load(std::memory_order_relaxed)) {
+			case LowPass:
+				B0 = 0.5f * (1.0f - cosw); B1 = 1.0f - cosw; B2 = 0.5f * (1.0f - cosw);
+				A0 = 1.0f + alpha; A1 = -2.0f * cosw; A2 = 1.0f - alpha;
+				break;
+			case HighPass:
+				B0 = 0.5f * (1.0f + cosw); B1 = -(1.0f + cosw); B2 = 0.5f * (1.0f + cosw);
+				A0 = 1.0f + alpha; A1 = -2.0f * cosw; A2 = 1.0f - alpha;
+				break;
+			case BandPass:
+				B0 = alpha; B1 = 0.0f; B2 = -alpha;
+				A0 = 1.0f + alpha; A1 = -2.0f * cosw; A2 = 1.0f - alpha;
+				break;
+			case Notch:
+				B0 = 1.0f; B1 = -2.0f * cosw; B2 = 1.0f;
+				A0 = 1.0f + alpha; A1 = -2.0f * cosw; A2 = 1.0f - alpha;
+				break;
+			case Peaking:
+				B0 = 1.0f + alpha * A; B1 = -2.0f * cosw; B2 = 1.0f - alpha * A;
+				A0 = 1.0f + alpha / A; A1 = -2.0f * cosw; A2 = 1.0f - alpha / A;
+				break;
+			case LowShelf:
+				B0 = A * ((A + 1.0f) - (A - 1.0f) * cosw + sqA2alpha);
+				B1 = 2.0f * A * ((A - 1.0f) - (A + 1.0f) * cosw);
+				B2 = A * ((A + 1.0f) - (A - 1.0f) * cosw - sqA2alpha);
+				A0 = (A + 1.0f) + (A - 1.0f) * cosw + sqA2alpha;
+				A1 = -2.0f * ((A - 1.0f) + (A + 1.0f) * cosw);
+				A2 = (A + 1.0f) + (A - 1.0f) * cosw - sqA2alpha;
+				break;
+			case HighShelf:
+				B0 = A * ((A + 1.0f) + (A - 1.0f) * cosw + sqA2alpha);
+				B1 = -2.0f * A * ((A - 1.0f) + (A + 1.0f) * cosw);
+				B2 = A * ((A + 1.0f) + (A - 1.0f) * cosw - sqA2alpha);
+				A0 = (A + 1.0f) - (A - 1.0f) * cosw + sqA2alpha;
+				A1 = 2.0f * ((A - 1.0f) - (A + 1.0f) * cosw);
+				A2 = (A + 1.0f) - (A - 1.0f) * cosw - sqA2alpha;
+				break;
+		}
+		b0 = B0 / A0; b1 = B1 / A0; b2 = B2 / A0;
+		a1 = A1 / A0; a2 = A2 / A0;
+	}
+
+	//transposed direct form II, both channels at once:
+#ifdef SOUND_EFFECTS_SSE2
+	//(left, right) in the low two lanes:
+	__m128 B0 = _mm_set1_ps(b0), B1 = _mm_set1_ps(b1), B2 = _mm_set1_ps(b2);
+	__m128 A1 = _mm_set1_ps(a1), A2 = _mm_set1_ps(a2);
+	__m128 Z1 = _mm_setr_ps(z1[0], z1[1], 0.0f, 0.0f);
+	__m128 Z2 = _mm_setr_ps(z2[0], z2[1], 0.0f, 0.0f);
+	for (uint32_t s = 0; s < count; ++s) {
+		double *frame = reinterpret_cast< double * >(frames + 2*s);
+		__m128 x = _mm_castpd_ps(_mm_load_sd(frame));
+		__m128 y = _mm_add_ps(_mm_mul_ps(B0, x), Z1);
+		Z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(B1, x), _mm_mul_ps(A1, y)), Z2);
+		Z2 = _mm_sub_ps(_mm_mul_ps(B2, x), _mm_mul_ps(A2, y));
+		_mm_store_sd(frame, _mm_castps_pd(y));
+	}
+	alignas(16) float z[4];
+	_mm_store_ps(z, Z1);
+	z1[0] = z[0]; z1[1] = z[1];
+	_mm_store_ps(z, Z2);
+	z2[0] = z[0]; z2[1] = z[1];
+#else
+	for (uint32_t s = 0; s < count; ++s) {
+		for (uint32_t c = 0; c < 2; ++c) {
+			float x = frames[2*s+c];
+			float y = b0 * x + z1[c];
+			z1[c] = b1 * x - a1 * y + z2[c];
+			z2[c] = b2 * x - a2 * y;
+			frames[2*s+c] = y;
+		}
+	}
+#endif
+	for (uint32_t c = 0; c < 2; ++c) {
+		z1[c] = flush(z1[c]);
+		z2[c] = flush(z2[c]);
+	}
+}
+
+//------------------------ Compressor --------------------------------
+
+Sound::Compressor::Compressor(float threshold_db_, float ratio_, float attack_, float release_, float makeup_db_) {
+	set(threshold_db_, ratio_, attack_, release_, makeup_db_);
+}
+
+void Sound::Compressor::set(float threshold_db_, float ratio_, float attack_, float release_, float makeup_db_) {
+	threshold_db.store(threshold_db_, std::memory_order_relaxed);
+	ratio.store(ratio_, std::memory_order_relaxed);
+	attack.store(attack_, std::memory_order_relaxed);
+	release.store(release_, std::memory_order_relaxed);
+	makeup_db.store(makeup_db_, std::memory_order_relaxed);
+	parameters_changed();
+}
+
+void Sound::Compressor::process(float *frames, uint32_t count) {
+	if (check_parameters()) {
+		threshold = db_to_gain(threshold_db.load(std::memory_order_relaxed));
+		slope = 1.0f - 1.0f / std::max(1.0f, ratio.load(std::memory_order_relaxed));
+		//one-pole smoothing that gets ~63% of the way to a new level in 'attack' (or 'release') seconds:
+		attack_coef = std::exp(-1.0f / (std::max(1.0e-4f, attack.load(std::memory_order_relaxed)) * SAMPLE_RATE));
+		release_coef = std::exp(-1.0f / (std::max(1.0e-4f, release.load(std::memory_order_relaxed)) * SAMPLE_RATE));
+		makeup = db_to_gain(makeup_db.load(std::memory_order_relaxed));
+	}
+
+	//the envelope follows every frame, but the gain (a pow) is only worked out every GainStep frames,
+	// ramping linearly in between (16 frames is a third of a millisecond, quicker than any useful attack):
+	constexpr uint32_t const GainStep = 16;
+	for (uint32_t begin = 0; begin < count; begin += GainStep) {
+		uint32_t const n = std::min(GainStep, count - begin);
+		float *step_frames = frames + 2 * begin;
+
+		//follow the peak level:
+		for (uint32_t s = 0; s < n; ++s) {
+			float level = std::max(std::abs(step_frames[2*s+0]), std::abs(step_frames[2*s+1]));
+			float coef = (level > envelope ? attack_coef : release_coef);
+			envelope = level + coef * (envelope - level);
+		}
+
+		//above the threshold, output level grows only 1/ratio as fast (in dB) as input level:
+		float target = makeup;
+		if (envelope > threshold) target *= std::pow(envelope / threshold, -slope);
+		float const step = (target - gain) / float(n);
+
+		//frame s gets gain + (s + 1) * step, reaching 'target' at the last one:
+		uint32_t s = 0;
+#ifdef SOUND_EFFECTS_SSE2
+		__m128 const Gain = _mm_set1_ps(gain), Step = _mm_set1_ps(step);
+		__m128 const Index = _mm_setr_ps(1.0f, 1.0f, 2.0f, 2.0f); //(two frames at a time)
+		for (; s + 2 <= n; s += 2) {
+			__m128 g = _mm_add_ps(Gain, _mm_mul_ps(Step, _mm_add_ps(Index, _mm_set1_ps(float(s)))));
+			_mm_storeu_ps(step_frames + 2*s, _mm_mul_ps(_mm_loadu_ps(step_frames + 2*s), g));
+		}
+#endif
+		for (; s < n; ++s) {
+			float g = gain + step * float(s + 1);
+			step_frames[2*s+0] *= g;
+			step_frames[2*s+1] *= g;
+		}
+		gain = target;
+	}
+	envelope = flush(envelope);
+}
+
+//------------------------ Reverb --------------------------------
+
+//Freeverb's delay lengths (in samples at 44.1kHz), scaled to 48kHz;
+// the right channel's are a bit longer, so the channels decorrelate:
+static constexpr uint32_t const COMB_LENGTHS[Sound::Reverb::Combs] = { 1215, 1293, 1390, 1476 };
+static constexpr uint32_t const ALLPASS_LENGTHS[Sound::Reverb::Allpasses] = { 605, 480 };
+static constexpr uint32_t const STEREO_SPREAD = 25;
+
+//Reverb::process runs each filter over this many frames at a time; every delay is longer, so a chunk's
+// delayed samples can all be read before any of its new ones are written:
+static constexpr uint32_t const REVERB_CHUNK = 256;
+static_assert(REVERB_CHUNK < ALLPASS_LENGTHS[1] && REVERB_CHUNK < COMB_LENGTHS[0], "delays are longer than a chunk");
+
+//helper: call 'f(offset, length)' for each piece of a run of 'n' elements of a ring buffer of 'size' elements
+// that starts at 'i' (two pieces, if it wraps around), and return where the run ends:
+template< typename F >
+static uint32_t ring_pieces(uint32_t i, uint32_t n, uint32_t size, F &&f) {
+	uint32_t first = std::min(n, size - i);
+	f(i, 0, first);
+	if (first < n) f(0, first, n - first);
+	i += n;
+	return (i >= size ? i - size : i);
+}
+
+//helper: run one channel's damped combs over 'n' frames of 'input', setting 'output' to their sum:
+static void run_combs(Sound::Reverb::Comb *combs, float const *input, float *output, uint32_t n, float damp, float feedback) {
+	constexpr uint32_t const Combs = Sound::Reverb::Combs;
+#ifdef SOUND_EFFECTS_SSE2
+	static_assert(Combs == 4, "one comb per lane");
+	//read every comb's delayed samples for the chunk:
+	alignas(16) float delayed[Combs][REVERB_CHUNK];
+	for (uint32_t k = 0; k < Combs; ++k) {
+		float const *buffer = combs[k].buffer.data();
+		ring_pieces(combs[k].i, n, uint32_t(combs[k].buffer.size()), [&](uint32_t at, uint32_t s, uint32_t length) {
+			std::copy(buffer + at, buffer + at + length, delayed[k] + s);
+		});
+	}
+	//the output is their sum:
+	uint32_t s = 0;
+	for (; s + 4 <= n; s += 4) {
+		__m128 sum = _mm_load_ps(delayed[0] + s);
+		for (uint32_t k = 1; k < Combs; ++k) sum = _mm_add_ps(sum, _mm_load_ps(delayed[k] + s));
+		_mm_storeu_ps(output + s, sum);
+	}
+	for (; s < n; ++s) {
+		float sum = delayed[0][s];
+		for (uint32_t k = 1; k < Combs; ++k) sum += delayed[k][s];
+		output[s] = sum;
+	}
+	//the damping filters are recursive, so run the four combs side by side, one per lane, a frame at a time
+	// (transposing four frames at a time in and out), replacing each delayed sample with the one to write back:
+	__m128 const Damp = _mm_set1_ps(damp), Feedback = _mm_set1_ps(feedback);
+	__m128 store = _mm_setr_ps(combs[0].store, combs[1].store, combs[2].store, combs[3].store);
+	s = 0;
+	for (; s + 4 <= n; s += 4) {
+		__m128 d0 = _mm_load_ps(delayed[0] + s), d1 = _mm_load_ps(delayed[1] + s);
+		__m128 d2 = _mm_load_ps(delayed[2] + s), d3 = _mm_load_ps(delayed[3] + s);
+		_MM_TRANSPOSE4_PS(d0, d1, d2, d3); //(now d<j> holds frame s+j of each comb)
+		__m128 *frame[4] = {&d0, &d1, &d2, &d3};
+		for (uint32_t j = 0; j < 4; ++j) {
+			__m128 out = *frame[j];
+			store = _mm_add_ps(out, _mm_mul_ps(Damp, _mm_sub_ps(store, out)));
+			*frame[j] = _mm_add_ps(_mm_set1_ps(input[s + j]), _mm_mul_ps(store, Feedback));
+		}
+		_MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+		_mm_store_ps(delayed[0] + s, d0); _mm_store_ps(delayed[1] + s, d1);
+		_mm_store_ps(delayed[2] + s, d2); _mm_store_ps(delayed[3] + s, d3);
+	}
+	alignas(16) float stores[4];
+	_mm_store_ps(stores, store);
+	for (uint32_t k = 0; k < Combs; ++k) {
+		for (uint32_t t = s; t < n; ++t) {
+			float out = delayed[k][t];
+			stores[k] = out + damp * (stores[k] - out);
+			delayed[k][t] = input[t] + stores[k] * feedback;
+		}
+	}
+	//...and write them back:
+	for (uint32_t k = 0; k < Combs; ++k) {
+		float *buffer = combs[k].buffer.data();
+		combs[k].i = ring_pieces(combs[k].i, n, uint32_t(combs[k].buffer.size()), [&](uint32_t at, uint32_t t, uint32_t length) {
+			std::copy(delayed[k] + t, delayed[k] + t + length, buffer + at);
+		});
+		combs[k].store = flush(stores[k]);
+	}
+#else
+	std::fill(output, output + n, 0.0f);
+	for (uint32_t k = 0; k < Combs; ++k) {
+		Sound::Reverb::Comb &comb = combs[k];
+		float *buffer = comb.buffer.data();
+		float store = comb.store;
+		comb.i = ring_pieces(comb.i, n, uint32_t(comb.buffer.size()), [&](uint32_t at, uint32_t s, uint32_t length) {
+			for (uint32_t t = 0; t < length; ++t) {
+				float out = buffer[at + t];
+				store = out + damp * (store - out);
+				buffer[at + t] = input[s + t] + store * feedback;
+				output[s + t] += out;
+			}
+		});
+		comb.store = flush(store);
+	}
+#endif
+}
+
+//helper: run 'output' (n frames) through an allpass, in place:
+static void run_allpass(Sound::Reverb::Allpass *allpass, float *output, uint32_t n) {
+	float *buffer = allpass->buffer.data();
+	allpass->i = ring_pieces(allpass->i, n, uint32_t(allpass->buffer.size()), [&](uint32_t at, uint32_t s, uint32_t length) {
+		float *delay = buffer + at;
+		float *out = output + s;
+		uint32_t t = 0;
+#ifdef SOUND_EFFECTS_SSE2
+		__m128 const Half = _mm_set1_ps(0.5f);
+		for (; t + 4 <= length; t += 4) {
+			__m128 delayed = _mm_loadu_ps(delay + t), in = _mm_loadu_ps(out + t);
+			_mm_storeu_ps(delay + t, _mm_add_ps(in, _mm_mul_ps(Half, delayed)));
+			_mm_storeu_ps(out + t, _mm_sub_ps(delayed, in));
+		}
+#endif
+		for (; t < length; ++t) {
+			float delayed = delay[t];
+			delay[t] = out[t] + 0.5f * delayed;
+			out[t] = delayed - out[t];
+		}
+	});
+}
+
+Sound::Reverb::Reverb(float room_size_, float damping_, float wet_, float dry_) {
+	for (uint32_t c = 0; c < 2; ++c) {
+		for (uint32_t i = 0; i < Combs; ++i) {
+			combs[c][i].buffer.assign(COMB_LENGTHS[i] + c * STEREO_SPREAD, 0.0f);
+		}
+		for (uint32_t i = 0; i < Allpasses; ++i) {
+			allpasses[c][i].buffer.assign(ALLPASS_LENGTHS[i] + c * STEREO_SPREAD, 0.0f);
+		}
+	}
+	set(room_size_, damping_, wet_, dry_);
+}
+
+void Sound::Reverb::set(float room_size_, float damping_, float wet_, float dry_) {
+	room_size.store(room_size_, std::memory_order_relaxed);
+	damping.store(damping_, std::memory_order_relaxed);
+	wet.store(wet_, std::memory_order_relaxed);
+	dry.store(dry_, std::memory_order_relaxed);
+	parameters_changed();
+}
+
+void Sound::Reverb::process(float *frames, uint32_t count) {
+	if (check_parameters()) {
+		feedback = 0.7f + 0.28f * std::max(0.0f, std::min(1.0f, room_size.load(std::memory_order_relaxed)));
+		damp = 0.4f * std::max(0.0f, std::min(1.0f, damping.load(std::memory_order_relaxed)));
+		wet_gain = wet.load(std::memory_order_relaxed);
+		dry_gain = dry.load(std::memory_order_relaxed);
+	}
+
+	//Freeverb's fixed input gain, plus a tiny offset that keeps the combs out of denormal range:
+	constexpr float const InputGain = 0.015f;
+	constexpr float const AntiDenormal = 1.0e-18f;
+
+	//each filter runs over a whole chunk of frames at a time:
+	float input[REVERB_CHUNK];
+	float output[2][REVERB_CHUNK];
+	for (uint32_t begin = 0; begin < count; begin += REVERB_CHUNK) {
+		uint32_t const n = std::min(REVERB_CHUNK, count - begin);
+		float *chunk = frames + 2 * begin;
+		uint32_t s = 0;
+#ifdef SOUND_EFFECTS_SSE2
+		__m128 const Gain = _mm_set1_ps(InputGain), Offset = _mm_set1_ps(AntiDenormal);
+		for (; s + 4 <= n; s += 4) {
+			__m128 a = _mm_loadu_ps(chunk + 2*s), b = _mm_loadu_ps(chunk + 2*s + 4);
+			__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+			_mm_storeu_ps(input + s, _mm_add_ps(_mm_mul_ps(_mm_add_ps(l, r), Gain), Offset));
+		}
+#endif
+		for (; s < n; ++s) {
+			input[s] = (chunk[2*s+0] + chunk[2*s+1]) * InputGain + AntiDenormal;
+		}
+
+		for (uint32_t c = 0; c < 2; ++c) {
+			run_combs(combs[c], input, output[c], n, damp, feedback);
+			for (Allpass &allpass : allpasses[c]) {
+				run_allpass(&allpass, output[c], n);
+			}
+		}
+
+		s = 0;
+#ifdef SOUND_EFFECTS_SSE2
+		__m128 const Dry = _mm_set1_ps(dry_gain), Wet = _mm_set1_ps(wet_gain);
+		for (; s + 2 <= n; s += 2) {
+			//(left, right) of frames s and s+1:
+			__m128 out = _mm_unpacklo_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast< __m64 const * >(output[0] + s)),
+				_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast< __m64 const * >(output[1] + s)));
+			_mm_storeu_ps(chunk + 2*s, _mm_add_ps(_mm_mul_ps(Dry, _mm_loadu_ps(chunk + 2*s)), _mm_mul_ps(Wet, out)));
+		}
+#endif
+		for (; s < n; ++s) {
+			for (uint32_t c = 0; c < 2; ++c) {
+				chunk[2*s+c] = dry_gain * chunk[2*s+c] + wet_gain * output[c][s];
+			}
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Sound.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//Effects for Sound's buses (see Sound::set_bus_effects).
+//
+//Effects run on the audio thread, processing a bus's whole block (interleaved stereo, 48kHz) at once.
+// Their set() functions may be called from any thread at any time; new parameters are picked up
+// at the start of the next block.
+
+namespace Sound {
+
+struct Effect {
+	virtual ~Effect() = default;
+
+	//process 'count' interleaved (left, right) frames in place (audio thread only):
+	virtual void process(float *frames, uint32_t count) = 0;
+
+	//internals:
+	//set() functions call this after storing new parameters:
+	void parameters_changed() { version.fetch_add(1, std::memory_order_release); }
+	//process() calls this to find out if it needs to re-read its parameters:
+	bool check_parameters() {
+		uint32_t v = version.load(std::memory_order_acquire);
+		if (v == seen_version) return false;
+		seen_version = v;
+		return true;
+	}
+	std::atomic< uint32_t > version{1};
+	uint32_t seen_version = 0; //(audio thread only)
+};
+
+//Biquad ("two-pole, two-zero") filter, with the responses from the Audio EQ Cookbook:
+struct Biquad : Effect {
+	enum Type : uint8_t {
+		LowPass,
+		HighPass,
+		BandPass,
+		Notch,
+		Peaking, //uses gain_db
+		LowShelf, //uses gain_db
+		HighShelf, //uses gain_db
+	};
+	//'frequency' in Hz; 'q' controls the width of the transition (0.7071 is the flattest):
+	Biquad(Type type, float frequency, float q = 0.7071f, float gain_db = 0.0f);
+	void set(Type type, float frequency, float q = 0.7071f, float gain_db = 0.0f);
+
+	virtual void process(float *frames, uint32_t count) override;
+
+	//internals:
+	std::atomic< Type > type;
+	std::atomic< float > frequency, q, gain_db;
+
+	//normalized coefficients (a0 == 1) and per-channel state, for the audio thread:
+	float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+	float z1[2] = {0.0f, 0.0f};
+	float z2[2] = {0.0f, 0.0f};
+};
+
+//Feed-forward compressor (stereo-linked, so the image doesn't shift as it works;
+// the gain is worked out every 16 frames, and ramps smoothly in between):
+struct Compressor : Effect {
+	//levels above 'threshold_db' are reduced by a factor of 'ratio'; 'attack' and 'release' are in seconds;
+	// 'makeup_db' is applied afterward to bring the level back up:
+	Compressor(float threshold_db = -18.0f, float ratio = 4.0f, float attack = 0.005f, float release = 0.1f, float makeup_db = 0.0f);
+	void set(float threshold_db, float ratio, float attack, float release, float makeup_db);
+
+	virtual void process(float *frames, uint32_t count) override;
+
+	//internals:
+	std::atomic< float > threshold_db, ratio, attack, release, makeup_db;
+
+	//audio thread's copies (as gains and per-frame coefficients):
+	float threshold = 1.0f;
+	float slope = 0.0f; //(1 - 1 / ratio)
+	float attack_coef = 0.0f, release_coef = 0.0f;
+	float makeup = 1.0f;
+	float envelope = 0.0f;
+	float gain = 1.0f; //(applied at the last frame processed; the next gain ramps from here)
+};
+
+//Small room reverb (in the style of Freeverb: parallel damped combs into series allpasses, per channel):
+struct Reverb : Effect {
+	//'room_size' and 'damping' range from 0 to 1; 'wet' and 'dry' are gains for the reverb and the input:
+	Reverb(float room_size = 0.5f, float damping = 0.5f, float wet = 0.3f, float dry = 1.0f);
+	void set(float room_size, float damping, float wet, float dry);
+
+	virtual void process(float *frames, uint32_t count) override;
+
+	//internals:
+	std::atomic< float > room_size, damping, wet, dry;
+
+	static constexpr uint32_t const Combs = 4;
+	static constexpr uint32_t const Allpasses = 2;
+	struct Comb {
+		std::vector< float > buffer;
+		uint32_t i = 0;
+		float store = 0.0f; //damping filter state
+	};
+	struct Allpass {
+		std::vector< float > buffer;
+		uint32_t i = 0;
+	};
+	Comb combs[2][Combs];
+	Allpass allpasses[2][Allpasses];
+
+	//audio thread's copies:
+	float feedback = 0.0f, damp = 0.0f, wet_gain = 0.0f, dry_gain = 1.0f;
+};
+
+} //namespace Sound
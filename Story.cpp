@@ -0,0 +1,210 @@
+#include "Story.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	//Walks the script buffer one line at a time, handing out views into it:
+	struct ScriptReader {
+		std::string_view rest;
+		size_t line_number = 0;
+
+		bool next_line(std::string_view *line) {
+			if (rest.empty()) return false;
+			size_t end = rest.find('\n');
+			*line = rest.substr(0, end);
+			rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+			//tolerate scripts saved with DOS line endings:
+			if (!line->empty() && line->back() == '\r') line->remove_suffix(1);
+			++line_number;
+			return true;
+		}
+
+		[[noreturn]] void fail(std::string const &what) const {
+			throw std::runtime_error("Script line " + std::to_string(line_number) + ": " + what);
+		}
+	};
+
+	//split the next whitespace-separated token off the front of 'line':
+	std::string_view next_token(std::string_view *line) {
+		size_t begin = line->find_first_not_of(" \t");
+		if (begin == std::string_view::npos) {
+			*line = std::string_view();
+			return std::string_view();
+		}
+		line->remove_prefix(begin);
+		size_t end = line->find_first_of(" \t");
+		std::string_view token = line->substr(0, end);
+		line->remove_prefix(token.size());
+		return token;
+	}
+
+	bool parse_int(std::string_view token, int *value) {
+		//like std::stoi, accept an explicit '+' sign (the script uses it for stat changes):
+		if (token.size() > 1 && token[0] == '+' && token[1] != '-') token.remove_prefix(1);
+		char const *end = token.data() + token.size();
+		auto result = std::from_chars(token.data(), end, *value);
+		return result.ec == std::errc() && result.ptr == end;
+	}
+
+	bool parse_float(std::string_view token, float *value) {
+		//floating point std::from_chars isn't available on every toolchain we build with,
+		// so copy the (short) token to the stack and use strtof:
+		char buffer[32];
+		if (token.empty() || token.size() >= sizeof(buffer)) return false;
+		std::memcpy(buffer, token.data(), token.size());
+		buffer[token.size()] = '\0';
+		char *end = nullptr;
+		*value = std::strtof(buffer, &end);
+		return end == buffer + token.size();
+	}
+}
+
+Story::Branches::const_iterator Story::Branches::find(std::string_view name) const {
+	auto found = std::lower_bound(sorted.begin(), sorted.end(), name, [](auto const &entry, std::string_view n) {
+		return entry.first < n;
+	});
+	if (found == sorted.end() || found->first != name) return sorted.end();
+	return found;
+}
+
+Story::Branch const &Story::Branches::at(std::string_view name) const {
+	auto found = find(name);
+	if (found == sorted.end()) throw std::out_of_range("Story::Branches::at");
+	return found->second;
+}
+
+Story Story::parse(std::shared_ptr<std::string const> source_) {
+	Story ret;
+	ret.source = std::move(source_);
+	ScriptReader reader{std::string_view(*ret.source)};
+	std::string_view line;
+
+	// size every array once, from a quick count of the script's lines: each line holds at most one text
+	// (a line, or an option -- which takes two lines with its branch name), and each branch but the last ends at a blank line
+	size_t line_count = 0, blank_count = 0;
+	for (ScriptReader counter{reader.rest}; counter.next_line(&line); ) {
+		++line_count;
+		if (line.empty()) ++blank_count;
+	}
+	auto arrays = std::make_shared<Arrays>();
+	arrays->lines.reserve(line_count);
+	arrays->option_texts.reserve(line_count / 2);
+	arrays->next_branch_names.reserve(line_count / 2);
+	ret.texts.reserve(line_count);
+	ret.stories.sorted.reserve(blank_count + 1);
+	ret.arrays = arrays;
+
+	// the first character is for narration
+	ret.characters.emplace_back(std::string_view(), glm::vec4(1, 1, 1, 1));
+
+	// read character data, first line would be the number of characters
+	int num_characters = 0;
+	if (!reader.next_line(&line) || !parse_int(next_token(&line), &num_characters) || num_characters < 0) {
+		reader.fail("expected number of characters");
+	}
+	ret.characters.reserve(1 + size_t(num_characters));
+	// the following n lines are character data with format: character name r g b a
+	while (num_characters--) {
+		if (!reader.next_line(&line)) reader.fail("expected character data");
+		std::string_view character_name = next_token(&line);
+		float rgba[4];
+		for (float &c : rgba) {
+			if (!parse_float(next_token(&line), &c)) reader.fail("expected 'name r g b a'");
+		}
+		ret.characters.emplace_back(character_name, glm::vec4(rgba[0], rgba[1], rgba[2], rgba[3]));
+	}
+
+	// reading branches of the story
+	while (reader.next_line(&line)) {
+		// blank lines separate branches
+		if (line.empty()) continue;
+
+		// first line is the name of the branch followed by its stat changes
+		Story::Branch branch;
+		std::string_view name = next_token(&line);
+		for (int *delta : {&branch.dtime, &branch.dbudget, &branch.dfan, &branch.dcoach}) {
+			if (!parse_int(next_token(&line), delta)) reader.fail("expected 'name dtime dbudget dfan dcoach'");
+		}
+		size_t const first_line = arrays->lines.size();
+		size_t const first_option = arrays->option_texts.size();
+
+		// read the lines and options in this branch, until the next blank line
+		while (reader.next_line(&line) && !line.empty()) {
+			size_t pos = line.find('.');
+			int index = 0;
+			if (pos == std::string_view::npos || !parse_int(line.substr(0, pos), &index)) {
+				reader.fail("expected 'N. line' or '-N.'");
+			}
+
+			// this is a line
+			if (index >= 0) {
+				if (size_t(index) >= ret.characters.size()) reader.fail("unknown character " + std::to_string(index));
+				arrays->lines.emplace_back(size_t(index), uint32_t(ret.texts.size()));
+				ret.texts.emplace_back(line.substr(pos + 1));
+			}
+			// options, each one is the option text followed by the branch it leads to
+			else {
+				for (int i = 0; i < -index; i++) {
+					std::string_view option_line, branch_name;
+					if (!reader.next_line(&option_line) || !reader.next_line(&branch_name)) {
+						reader.fail("expected option text and branch name");
+					}
+					arrays->option_texts.emplace_back(uint32_t(ret.texts.size()));
+					ret.texts.emplace_back(option_line);
+					arrays->next_branch_names.emplace_back(branch_name);
+				}
+			}
+		}
+		// (the arrays were sized up front, so these never move)
+		branch.lines = Span<Line>{arrays->lines.data() + first_line, arrays->lines.size() - first_line};
+		branch.option_texts = Span<uint32_t>{arrays->option_texts.data() + first_option, arrays->option_texts.size() - first_option};
+		branch.next_branch_names = Span<std::string_view>{arrays->next_branch_names.data() + first_option, arrays->next_branch_names.size() - first_option};
+		ret.stories.sorted.emplace_back(name, branch);
+	}
+
+	// sort the branches by name; if a name is used twice, the later branch wins
+	auto &sorted = ret.stories.sorted;
+	std::stable_sort(sorted.begin(), sorted.end(), [](auto const &a, auto const &b) {
+		return a.first < b.first;
+	});
+	size_t kept = 0;
+	for (size_t i = 0; i < sorted.size(); ++i) {
+		if (i + 1 < sorted.size() && sorted[i + 1].first == sorted[i].first) continue;
+		sorted[kept++] = sorted[i];
+	}
+	sorted.resize(kept);
+
+	return ret;
+}
+
+void Story::choose(State *state_, size_t option) const {
+	assert(state_);
+	auto &state = *state_;
+
+	std::string_view next_branch_name = stories.at(state.branch).next_branch_names.at(option);
+	Branch const &next = stories.at(next_branch_name);
+
+	// n.b. running past week 8 doesn't end the game early; the chosen branch still plays
+	state.week += next.dtime;
+	state.budget += next.dbudget;
+	state.fan = std::clamp(state.fan + next.dfan, 0, 10);
+	// the coach cares twice as much about the first month
+	state.coach += next.dcoach;
+	if (state.week <= 4) {
+		state.coach += next.dcoach;
+	}
+	state.coach = std::clamp(state.coach, 0, 10);
+
+	if (next_branch_name != "JadonYes" && state.budget < 0) {
+		state.budget -= next.dbudget;
+		next_branch_name = "JadonNoMoney";
+	}
+	state.budget = std::max(0, state.budget);
+
+	state.branch = next_branch_name;
+}
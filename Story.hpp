@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+ * A Story is the branching script loaded from dist/script.
+ *
+ * Script format:
+ *   number of characters
+ *   (name r g b a) * number of characters
+ *   (blank line)
+ *   branches, each one ended by a blank line:
+ *     name dtime dbudget dfan dcoach
+ *     N. line spoken by character N (0 is narration)
+ *     -K.                             <-- K options follow, two lines each:
+ *     option text
+ *     next branch name
+ *
+ * Lines and option text are stored as text ids (numbered in the order they
+ * appear in the script) and looked up through Story::text, so that a locale
+ * pack (see StringTable.hpp) can stand in for the script's own language.
+ * Names are std::string_views into 'source', and each branch's lines and
+ * options are Spans of arrays shared by the whole script; both are shared
+ * (not copied) when the Story is copied. Parsing allocates the same handful
+ * of times for any size of script: every array is sized once, up front.
+ */
+
+#include "StringTable.hpp"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct Story {
+	struct Line {
+		Line(size_t idx_, uint32_t text_) : character_idx(idx_), text(text_) {};
+		size_t character_idx;
+		uint32_t text; //text id
+	};
+
+	// a run of consecutive elements of one of the script-wide arrays (see 'arrays'):
+	template<typename T>
+	struct Span {
+		T const *first = nullptr;
+		size_t count = 0;
+
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		T const *begin() const { return first; }
+		T const *end() const { return first + count; }
+		T const &operator[](size_t i) const { return first[i]; }
+		T const &at(size_t i) const {
+			if (i >= count) throw std::out_of_range("Story::Span::at");
+			return first[i];
+		}
+	};
+
+	struct Branch {
+		Span<Line> lines;
+		size_t line_idx = 0;        // current line index
+
+		// options, ending will have zero length options
+		Span<uint32_t> option_texts; //text ids
+		Span<std::string_view> next_branch_names;
+
+		int dbudget = 0;
+		int dtime = 0;
+		int dfan = 0;
+		int dcoach = 0;
+	};
+
+	// every branch's lines and options, one after another (the branches' Spans point in here):
+	struct Arrays {
+		std::vector<Line> lines;
+		std::vector<uint32_t> option_texts;
+		std::vector<std::string_view> next_branch_names;
+	};
+	std::shared_ptr<Arrays const> arrays;
+
+	// all the branches, sorted by name (looked up like a std::map):
+	struct Branches {
+		std::vector<std::pair<std::string_view, Branch>> sorted;
+
+		using const_iterator = std::vector<std::pair<std::string_view, Branch>>::const_iterator;
+		size_t size() const { return sorted.size(); }
+		const_iterator begin() const { return sorted.begin(); }
+		const_iterator end() const { return sorted.end(); }
+		// the branch named 'name', or end() if there isn't one:
+		const_iterator find(std::string_view name) const;
+		// the branch named 'name'; throws std::out_of_range if there isn't one:
+		Branch const &at(std::string_view name) const;
+	};
+	Branches stories;
+
+	// character's name and line's color
+	std::vector<std::pair<std::string_view, glm::vec4>> characters;
+
+	// the script's own text for each text id:
+	std::vector<std::string_view> texts;
+
+	// if set, text comes from this locale pack instead (ids it lacks fall back to the script):
+	StringTable const *language = nullptr;
+
+	std::string_view text(uint32_t id) const {
+		if (language && id < language->count) return language->get(id);
+		return texts.at(id);
+	}
+
+	// script text that all of the views above point into:
+	std::shared_ptr<std::string const> source;
+
+	// the player's progress, as changed by choose():
+	struct State {
+		std::string_view branch; // name of the current branch
+		int budget = 0;
+		int fan = 5;
+		int coach = 5;
+		int week = 1;
+	};
+
+	// apply the rules for picking option 'option' in the current branch; moves 'state' to the next branch:
+	void choose(State *state, size_t option) const;
+
+	//Parse a script in a single pass over 'source'; throws std::runtime_error on malformed input:
+	static Story parse(std::shared_ptr<std::string const> source);
+};
@@ -11,95 +11,61 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <random>
 
 #include <hb.h>
 #include <hb-ft.h>
 #include <freetype/freetype.h>
+#include <filesystem>
 #include <fstream>
 #include <string>
 #include <utility>
 
 
 
-std::string parseHeader(std::string &line){
-	size_t pos = line.find(" ");
-	std::string token = line.substr(0, pos);
-	line.erase(0, pos+1);
-	return token;
-}
-
-
-Load<Story> transfer_saga(LoadTagDefault, []() -> Story * {
-	Story *ret = new Story();
+Load<Story> transfer_saga(LoadTagParallel, []() -> Story * {
+	// read the whole script into memory; the story refers to it rather than copying each line
 	std::string path = data_path("script");
-	std::ifstream script_file(path);
-	std::string line;
-	if (script_file.is_open()) {
-		// the first character is for narration
-		ret->characters.emplace_back(std::make_pair("", glm::vec4(1, 1, 1, 1)));
-		// read character data, first line would be the number of characters
-		std::string str_num_characters;
-		getline(script_file, str_num_characters);
-		int num_character = std::stoi(str_num_characters);
-		// the following n lines are character data with format: character name r g b a
-		std::string character_name;
-		float r, g, b, a;
-		while (num_character--) {
-			script_file >> character_name >> r >> g >> b >> a;
-			(ret->characters).emplace_back(std::make_pair(character_name, glm::vec4(r, g, b, a)));
-		}
+	std::ifstream script_file(path, std::ios::binary);
+	if (!script_file.is_open()) {
+		throw std::runtime_error("Failed to open script '" + path + "'.");
+	}
+	script_file.seekg(0, std::ios::end);
+	auto source = std::make_shared<std::string>(size_t(script_file.tellg()), '\0');
+	script_file.seekg(0, std::ios::beg);
+	if (!script_file.read(&(*source)[0], source->size())) {
+		throw std::runtime_error("Failed to read script '" + path + "'.");
+	}
+	return new Story(Story::parse(std::move(source)));
+});
 
-		// reading branches of the story
-		while (getline(script_file, line)) {
-			// first line is the name of story, create a key-value pair in stories map
-			Story::Branch branch;
-			std::string name = line;
-			if (!line.empty()){
-				name = parseHeader(line);
-				branch.dtime = stoi(parseHeader(line));
-				branch.dbudget = stoi(parseHeader(line));
-				branch.dfan= stoi(parseHeader(line));
-				branch.dcoach = stoi(parseHeader(line));
-			}
-			
-			
-			// read the lines and options in this branch
-			while (true) {
-				getline(script_file, line);
-				if (line.length() == 0) {
-					// the branch is finished, go to the next one
-					break;
-				}
-				size_t pos = line.find(".");
-				int index = std::stoi(line.substr(0, pos));
-				
-				// this is a line
-				if (index >= 0) {
-					branch.lines.push_back(Story::Line(index, line.substr(pos+1, line.length() - pos)));
-				} 
-				// options
-				else {
-					// int num_options = -index;
-					for (int i=0; i<-index; i++){
-						std::string option_line, branch_name;
-						getline(script_file, option_line);
-						getline(script_file, branch_name);
-						branch.option_lines.push_back(option_line);
-						branch.next_branch_names.push_back(branch_name);
-					}
-				}
-			}
-			ret->stories[name] = branch;
-		}
+// locale packs (dist/locale/<language>.strings), made from the script with make-strings:
+// (mapped alongside the script's parse, so they're checked against it below)
+Load<std::vector<std::pair<std::string, StringTable>>> locale_packs(LoadTagParallel, []() -> std::vector<std::pair<std::string, StringTable>> * {
+	auto *ret = new std::vector<std::pair<std::string, StringTable>>();
+	std::error_code ec; // no locale directory just means no packs
+	for (auto const &entry : std::filesystem::directory_iterator(data_path("locale"), ec)) {
+		if (entry.path().extension() != ".strings") continue;
+		ret->emplace_back(entry.path().stem().string(), StringTable(entry.path().string()));
 	}
+	std::sort(ret->begin(), ret->end(), [](auto const &a, auto const &b) { return a.first < b.first; });
 	return ret;
 });
 
+static Load<void> check_locale_packs(LoadTagDefault, [](){
+	for (auto const &[language, pack] : *locale_packs) {
+		if (pack.count != transfer_saga->texts.size()) {
+			std::cerr << "WARNING: locale pack '" << language << "' has " << pack.count
+			          << " strings but the script has " << transfer_saga->texts.size() << "; was it made from an older script?" << std::endl;
+		}
+	}
+});
+
 
-StoryMode::StoryMode() : story(*transfer_saga) {
+StoryMode::StoryMode() : story(*transfer_saga), autosaver(data_path("save.sav")) {
 	// set the timer and print the first line
-	setCurrentBranch(story.stories.at("Menu"));
+	setCurrentBranch("Menu");
 	info_line = std::make_shared<view::TextLine>(formatStatus(), 50, 650, glm::uvec4(255,255,255,255), 20, std::nullopt, true);
 
 }
@@ -120,31 +86,38 @@ bool StoryMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size
 		} else if (keyCode == SDLK_RETURN) {
 			std::optional<int> next_branch = main_dialog->Enter();
 			if (next_branch.has_value()) {
-				std::string next_branch_name = current.next_branch_names[next_branch.value()];
-				week += story.stories[next_branch_name].dtime;
-				if (week >= 8) setCurrentBranch(story.stories["End4"]);
-				budget += story.stories[next_branch_name].dbudget;
-				
-				fan += story.stories[next_branch_name].dfan;
-				fan = std::max(0, fan);
-				fan = std::min(10, fan);
-				coach += story.stories[next_branch_name].dcoach;
-				if (week <= 4){
-					coach += story.stories[next_branch_name].dcoach;
-				}
-				coach = std::max(0, coach);
-				coach = std::min(10, coach);
+				story.choose(&state, size_t(next_branch.value()));
 				info_line->setText(formatStatus(), std::nullopt);
-				if (next_branch_name.compare("JadonYes") && budget < 0){
-					budget -= story.stories[next_branch_name].dbudget;
-					next_branch_name = "JadonNoMoney";
-				}
-				budget = std::max(0, budget);
-				setCurrentBranch(story.stories[next_branch_name]);
+				setCurrentBranch(state.branch);
+				autosaver.save(snapshot());
 				return true;
 			} else {
 				return false;
 			}
+		} else if (keyCode == SDLK_F2) {
+			// cycle through the script's own language and the locale packs
+			language = (language + 1) % (locale_packs->size() + 1);
+			story.language = (language == 0 ? nullptr : &(*locale_packs)[language - 1].second);
+			std::cout << "Language: " << (language == 0 ? "script" : (*locale_packs)[language - 1].first) << std::endl;
+			// show the current branch again in the new language
+			restore(snapshot());
+			return true;
+		} else if (keyCode == SDLK_F5) {
+			autosaver.save(snapshot());
+			std::cout << "Saving game to '" << autosaver.filename << "'." << std::endl;
+			return true;
+		} else if (keyCode == SDLK_F9) {
+			SaveGame save;
+			try {
+				if (save.load(autosaver.filename)) {
+					restore(save);
+				} else {
+					std::cout << "No saved game in '" << autosaver.filename << "'." << std::endl;
+				}
+			} catch (std::exception const &e) {
+				std::cerr << "Failed to load saved game: " << e.what() << std::endl;
+			}
+			return true;
 		}
 	}
 	return false;
@@ -156,9 +129,9 @@ void StoryMode::update(float elapsed) {
 
 
 std::string StoryMode::formatStatus(){
-	return "Week "+std::to_string(week)+"/8    Remaining Budget: $"
-	+std::to_string(budget)+"m    Fan Support: "+std::to_string(fan)
-	+"/10    Coach Happiness: "+std::to_string(coach)+"/10";
+	return "Week "+std::to_string(state.week)+"/8    Remaining Budget: $"
+	+std::to_string(state.budget)+"m    Fan Support: "+std::to_string(state.fan)
+	+"/10    Coach Happiness: "+std::to_string(state.coach)+"/10";
 }
 
 void StoryMode::draw(glm::uvec2 const &drawable_size) {
@@ -180,7 +153,7 @@ bool StoryMode::show_next_line() {
 	if (current.line_idx < current.lines.size()) {
 		// show the current line on the screen
 		Story::Line current_line = current.lines.at(current.line_idx);
-		std::string to_show = story.characters.at(current_line.character_idx).first + " " + current_line.line;
+		std::string to_show = std::string(story.characters.at(current_line.character_idx).first) + " " + std::string(story.text(current_line.text));
 		// reset timer - TODO set it according to the length of the sentence
 		// go to next line
 		current.line_idx += 1;
@@ -189,12 +162,12 @@ bool StoryMode::show_next_line() {
 		std::cout << to_show << std::endl;
 		return true;
 	} else {
-		if (current.option_lines.size() > 0) {
+		if (current.option_texts.size() > 0) {
 			if (!option) {
 				option = true;
-				for (size_t i = 0; i < current.option_lines.size(); ++i) {
+				for (size_t i = 0; i < current.option_texts.size(); ++i) {
 					// TODO show options on screen
-					std::string option = "\t" + std::to_string(i+1) + " " + current.option_lines[i];
+					std::string option = "\t" + std::to_string(i+1) + " " + std::string(story.text(current.option_texts[i]));
 					std::cout  << option << std::endl;
 				}
 			}
@@ -204,14 +177,53 @@ bool StoryMode::show_next_line() {
 	return false;
 }
 
-void StoryMode::setCurrentBranch(const Story::Branch &new_branch) {
-	current = new_branch;
+SaveGame StoryMode::snapshot() const {
+	SaveGame save;
+	save.branch = std::string(state.branch);
+	save.line_idx = uint32_t(current.line_idx);
+	save.budget = state.budget;
+	save.fan = state.fan;
+	save.coach = state.coach;
+	save.week = state.week;
+	save.focus = main_dialog->GetFocus();
+	return save;
+}
+
+void StoryMode::restore(SaveGame const &save) {
+	auto found = story.stories.find(save.branch);
+	if (found == story.stories.end()) {
+		throw std::runtime_error("Saved branch '" + save.branch + "' is not in the script.");
+	}
+	state.budget = save.budget;
+	state.fan = save.fan;
+	state.coach = save.coach;
+	state.week = save.week;
+	info_line->setText(formatStatus(), std::nullopt);
+
+	setCurrentBranch(found->first);
+	current.line_idx = std::min< size_t >(save.line_idx, current.lines.size());
+	// jump straight to the options instead of replaying the text animation
+	main_dialog->FinishAnimation();
+	main_dialog->SetFocus(save.focus);
+}
+
+void StoryMode::setCurrentBranch(std::string_view name) {
+	auto found = story.stories.find(name);
+	if (found == story.stories.end()) {
+		throw std::runtime_error("Branch '" + std::string(name) + "' is not in the script.");
+	}
+	state.branch = found->first;
+	current = found->second;
 	option = true;
 	std::vector<std::pair<glm::uvec4, std::string>> prompts;
 	for (const auto &line : current.lines) {
 		glm::uvec4 color = glm::uvec4(story.characters.at(line.character_idx).second * 255.0f);
-		std::string to_show = story.characters.at(line.character_idx).first + " " + line.line;
+		std::string to_show = std::string(story.characters.at(line.character_idx).first) + " " + std::string(story.text(line.text));
 		prompts.emplace_back(color, to_show);
 	}
-	main_dialog = std::make_shared<view::Dialog>(prompts, current.option_lines);
+	std::vector<std::string> options;
+	for (uint32_t text : current.option_texts) {
+		options.emplace_back(story.text(text));
+	}
+	main_dialog = std::make_shared<view::Dialog>(prompts, options);
 }
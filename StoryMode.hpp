@@ -1,5 +1,8 @@
 #include "Mode.hpp"
 
+#include "Story.hpp"
+#include "SaveGame.hpp"
+
 #include "Scene.hpp"
 #include "Sound.hpp"
 #include "View.hpp"
@@ -10,34 +13,6 @@
 #include <vector>
 #include <deque>
 
-struct Story {
-	struct Line {
-		Line(int idx_, std::string line_) : character_idx(idx_), line(line_) {};
-		size_t character_idx;
-		std::string line;
-	};
-
-	struct Branch {
-		std::vector<Line> lines;
-		size_t line_idx = 0;        // current line index
-
-		// options, ending will have zero length options
-		std::vector<std::string> option_lines;
-		std::vector<std::string> next_branch_names;
-
-		int dbudget = 0;
-		int dtime = 0;
-		int dfan = 0;
-		int dcoach = 0;
-	};
-
-	// all the branches, key is the name of the branches,
-	std::map<std::string, Branch> stories;
-
-	// character's name and line's color
-	std::vector<std::pair<std::string, glm::vec4>> characters;
-};
-
 struct StoryMode : Mode {
 	StoryMode();
 	virtual ~StoryMode();
@@ -51,10 +26,7 @@ struct StoryMode : Mode {
 
 	std::shared_ptr<view::Dialog> main_dialog = nullptr;
 	std::shared_ptr<view::TextLine> info_line = nullptr;
-	int budget = 0;
-	int fan = 5;
-	int coach = 5;
-	int week = 1;
+	Story::State state;
 
 	// current status, true = option mode, ignore timer, waiting for player's input; false = story mode, keep showing the next line
 	bool option = false;
@@ -67,7 +39,17 @@ struct StoryMode : Mode {
 
 	std::string formatStatus();
 
+	//capture or restore everything needed to resume play:
+	SaveGame snapshot() const;
+	void restore(SaveGame const &save);
+
+	// 0 is the script's own language, otherwise an index (plus one) into the locale packs:
+	size_t language = 0;
+
+	// saves after every choice, without blocking the frame (to save.sav next to the game's data; see data_path.hpp):
+	AutoSaver autosaver;
+
 private:
-	void setCurrentBranch(const Story::Branch &new_branch);
+	void setCurrentBranch(std::string_view name);
 
 };
@@ -0,0 +1,72 @@
+#include "StringTable.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+//helper: find the chunk with 'magic' at 'offset' in a mapped file, like read_chunk but without copying:
+static char const *map_chunk(MappedFile const &file, size_t *offset, char const *magic, uint32_t *size) {
+	char const *bytes = reinterpret_cast< char const * >(file.data);
+	if (*offset + 8 > file.size || std::memcmp(bytes + *offset, magic, 4) != 0) {
+		throw std::runtime_error(std::string("Expected '") + magic + "' chunk in locale pack.");
+	}
+	std::memcpy(size, bytes + *offset + 4, 4);
+	if (*offset + 8 + *size > file.size) {
+		throw std::runtime_error(std::string("Locale pack '") + magic + "' chunk is truncated.");
+	}
+	char const *data = bytes + *offset + 8;
+	*offset += 8 + *size;
+	return data;
+}
+
+StringTable::StringTable(std::string const &filename) {
+	auto mapped = std::make_shared< MappedFile >(filename);
+
+	size_t offset = 0;
+	uint32_t offsets_size = 0, text_size = 0;
+	char const *offsets_data = map_chunk(*mapped, &offset, "offs", &offsets_size);
+	char const *text_data = map_chunk(*mapped, &offset, "text", &text_size);
+
+	if (offsets_size % 4 != 0 || offsets_size < 4) {
+		throw std::runtime_error("Locale pack '" + filename + "' has a malformed offset table.");
+	}
+	//(chunk headers are 8 bytes, so the offsets are always 4-byte aligned in the mapping)
+	uint32_t const *offs = reinterpret_cast< uint32_t const * >(offsets_data);
+	uint32_t offs_count = offsets_size / 4;
+	for (uint32_t i = 0; i + 1 < offs_count; ++i) {
+		if (offs[i] > offs[i+1]) {
+			throw std::runtime_error("Locale pack '" + filename + "' has decreasing offsets.");
+		}
+	}
+	if (offs[0] != 0 || offs[offs_count-1] > text_size) {
+		throw std::runtime_error("Locale pack '" + filename + "' has offsets outside of its text.");
+	}
+
+	count = offs_count - 1;
+	offsets = offs;
+	text = text_data;
+	file = mapped;
+}
+
+void StringTable::write(std::string const &filename, std::vector< std::string_view > const &strings) {
+	std::vector< uint32_t > offs;
+	std::vector< char > chars;
+	offs.reserve(strings.size() + 1);
+	offs.emplace_back(0);
+	for (auto const &s : strings) {
+		chars.insert(chars.end(), s.begin(), s.end());
+		offs.emplace_back(uint32_t(chars.size()));
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out.is_open()) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+	write_chunk("offs", offs, &out);
+	write_chunk("text", chars, &out);
+	if (!out) {
+		throw std::runtime_error("Failed to write '" + filename + "'.");
+	}
+}
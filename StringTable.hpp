@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * A StringTable is one language's text for a Story, addressed by text id.
+ *
+ * Locale packs are stored in read_write_chunk.hpp format:
+ *  |offs| chunk of (count + 1) uint32 offsets; string i is text[offs[i], offs[i+1])
+ *  |text| chunk of characters
+ *
+ * Packs are memory-mapped rather than read, so a loaded language only costs
+ * the pages that are actually displayed, and switching languages is just
+ * switching which table is used.
+ */
+
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct StringTable {
+	StringTable() = default;
+	//map a locale pack; throws on error:
+	explicit StringTable(std::string const &filename);
+
+	//string with id 'id' (empty if the table doesn't have it):
+	std::string_view get(uint32_t id) const {
+		if (id >= count) return std::string_view();
+		return std::string_view(text + offsets[id], offsets[id+1] - offsets[id]);
+	}
+
+	uint32_t count = 0;
+	uint32_t const *offsets = nullptr;
+	char const *text = nullptr;
+	std::shared_ptr< MappedFile const > file; //keeps offsets and text alive
+
+	//write a locale pack holding 'strings' in id order:
+	static void write(std::string const &filename, std::vector< std::string_view > const &strings);
+};
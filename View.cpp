@@ -201,6 +201,15 @@ void TextLine::update(float elapsed) {
 	}
 }
 
+void TextLine::finishAnimation() {
+	if (visibility_ && animation_speed_.has_value() && visible_glyph_count_ < glyph_count_) {
+		visible_glyph_count_ = glyph_count_;
+		if (callback_.has_value()) {
+			(*callback_)();
+		}
+	}
+}
+
 void TextLine::draw() {
 	if (!visibility_) { return; }
 	// Bind Stuff
@@ -292,6 +301,12 @@ void TextBox::update(float elapsed) {
 	}
 }
 
+void TextBox::finish_animation() {
+	for (auto &line : lines_) {
+		line->finishAnimation();
+	}
+}
+
 void TextBox::draw() {
 	for (auto &line : lines_) {
 		line->draw();
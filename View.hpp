@@ -119,6 +119,12 @@ public:
 
 	TextLine &setText(std::string content, std::optional<float> animation_speed);
 
+	/**
+	 * Skip the rest of the "appear letters one by one" animation (if the line is visible),
+	 * calling the animation callback as if it had finished on its own
+	 */
+	void finishAnimation();
+
 	void update(float elapsed);
 	void draw();
 
@@ -164,6 +170,8 @@ public:
 	        unsigned int fontSize,
 	        std::optional<float> animation_speed);
 	void update(float elapsed);
+	// show every line in full right away (each line's callback shows the next, so they all finish):
+	void finish_animation();
 	void draw();
 	void set_contents(std::vector<std::pair<glm::uvec4, std::string>> contents, std::optional<float> animation_speed);
 	int get_height() const { return static_cast<int>(font_size_ * contents_.size()); }
@@ -198,6 +206,10 @@ public:
 	void update(float elapsed) {
 		prompt_box_->update(elapsed);
 	}
+	// skip the prompt's animation, showing the whole prompt and the options:
+	void FinishAnimation() {
+		prompt_box_->finish_animation();
+	}
 
 	void MoveUp() {
 		if (options_shown_ && !options_.empty()) {
@@ -210,11 +222,20 @@ public:
 		}
 	}
 
+	int GetFocus() const {
+		return option_focus_;
+	}
+	void SetFocus(int index) {
+		if (!options_.empty()) {
+			SetOptionFocus(std::max<int>(0, std::min<int>(index, (int)options_.size() - 1)));
+		}
+	}
+
 	std::optional<int> Enter() {
 		if (options_shown_ && !options_.empty()) {
 			return std::make_optional(option_focus_);
 		} else {
-			update(100);
+			FinishAnimation();
 			return std::nullopt;
 		}
 	}
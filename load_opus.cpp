@@ -1,10 +1,13 @@
 #include "load_opus.hpp"
 
 #include <opusfile.h>
+#include <ogg/ogg.h>
 
 #include <cassert>
 #include <memory>
 #include <cmath>
+#include <cstring>
+#include <fstream>
 #include <stdexcept>
 #include <iostream>
 
@@ -52,3 +55,87 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 
 	std::cout << " done." << std::endl;
 }
+
+void load_opus_packets(std::string const &filename, OpusPackets *packets_) {
+	assert(packets_);
+	auto &packets = *packets_;
+	packets = OpusPackets();
+
+	std::cout << "loading '" << filename << "' (compressed)..."; std::cout.flush();
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open \"" + filename + "\".");
+	}
+
+	//libogg states hold buffers, so clean them up however this function exits:
+	struct Demuxer {
+		Demuxer() { ogg_sync_init(&sync); }
+		~Demuxer() {
+			if (have_stream) ogg_stream_clear(&stream);
+			ogg_sync_clear(&sync);
+		}
+		ogg_sync_state sync;
+		ogg_stream_state stream;
+		bool have_stream = false;
+		int serial = 0;
+	} demux;
+
+	uint32_t header_packets = 0; //'OpusHead' and 'OpusTags' come before the audio
+	ogg_int64_t last_granule = -1;
+	packets.offsets.emplace_back(0);
+
+	for (;;) {
+		char *buffer = ogg_sync_buffer(&demux.sync, 4096);
+		file.read(buffer, 4096);
+		ogg_sync_wrote(&demux.sync, long(file.gcount()));
+		if (file.gcount() == 0) break;
+
+		ogg_page page;
+		while (ogg_sync_pageout(&demux.sync, &page) == 1) {
+			if (!demux.have_stream) {
+				demux.serial = ogg_page_serialno(&page);
+				ogg_stream_init(&demux.stream, demux.serial);
+				demux.have_stream = true;
+			} else if (ogg_page_serialno(&page) != demux.serial) {
+				continue; //only the first logical stream is played (same as op_read with chained files)
+			}
+			ogg_stream_pagein(&demux.stream, &page);
+
+			ogg_packet packet;
+			int ret;
+			while ((ret = ogg_stream_packetout(&demux.stream, &packet)) != 0) {
+				if (ret < 0) continue; //gap in the data; skip
+				if (header_packets == 0) {
+					//identification header:
+					if (packet.bytes < 19 || std::memcmp(packet.packet, "OpusHead", 8) != 0) {
+						throw std::runtime_error("\"" + filename + "\" doesn't start with an opus header.");
+					}
+					packets.channels = packet.packet[9];
+					packets.pre_skip = uint32_t(packet.packet[10]) | (uint32_t(packet.packet[11]) << 8);
+					if (packet.packet[18] != 0 || packets.channels < 1 || packets.channels > 2) {
+						throw std::runtime_error("\"" + filename + "\" isn't mono or stereo; it can't be kept compressed.");
+					}
+					++header_packets;
+				} else if (header_packets == 1) {
+					//comment header; nothing needed from it
+					++header_packets;
+				} else {
+					packets.data.insert(packets.data.end(), packet.packet, packet.packet + packet.bytes);
+					packets.offsets.emplace_back(uint32_t(packets.data.size()));
+					if (packet.granulepos != -1) last_granule = packet.granulepos;
+				}
+			}
+		}
+	}
+
+	if (header_packets < 2) {
+		throw std::runtime_error("\"" + filename + "\" isn't an opus file.");
+	}
+	//the final granule position counts samples up to the (trimmed) end, including pre-skip:
+	if (last_granule > ogg_int64_t(packets.pre_skip)) {
+		packets.length = uint32_t(last_granule - packets.pre_skip);
+	}
+
+	std::cout << " done (" << packets.offsets.size() - 1 << " packets, " << packets.data.size() << " bytes)." << std::endl;
+}
@@ -1,7 +1,20 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 //Load an opus file as 48kHz floating-point mono; throws on error:
 void load_opus(std::string const &filename, std::vector< float > *data);
+
+//Opus packets from a (mono or stereo) .opus file, kept compressed for decoding later:
+struct OpusPackets {
+	std::vector< unsigned char > data; //all audio packets, back to back
+	std::vector< uint32_t > offsets; //packet i is data[offsets[i], offsets[i+1])
+	uint32_t channels = 0; //channels in the stream (the decoder can always downmix to mono)
+	uint32_t pre_skip = 0; //decoded samples to discard from the start of the stream
+	uint32_t length = 0; //samples to play after pre-skip
+};
+
+//Demux an opus file into packets (without decoding); throws on error:
+void load_opus_packets(std::string const &filename, OpusPackets *packets);
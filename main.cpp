@@ -11,6 +11,8 @@
 
 //For sound init:
 #include "Sound.hpp"
+#include "SampleCache.hpp"
+#include "data_path.hpp"
 
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
@@ -18,6 +20,9 @@
 //for screenshots:
 #include "load_save_png.hpp"
 
+//for recording and replaying play sessions:
+#include "InputLog.hpp"
+
 //Includes for libSDL:
 #include <SDL.h>
 
@@ -34,6 +39,36 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------  command line ------------
+
+	std::string record_filename; //if set, record input to this file
+	std::string replay_filename; //if set, replay input from this file instead of reading it from the player
+	bool headless = false; //if set (only when replaying), hide the window and skip drawing
+	bool binaural = false; //if set, render 3D sounds for headphones (see Sound::set_binaural)
+	bool low_latency = false; //if set, shrink the audio block size while this machine keeps up (see Sound::set_adaptive_block_frames)
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--record" && argi + 1 < argc) {
+			record_filename = argv[++argi];
+		} else if (arg == "--replay" && argi + 1 < argc) {
+			replay_filename = argv[++argi];
+		} else if (arg == "--headless") {
+			headless = true;
+		} else if (arg == "--binaural") {
+			binaural = true;
+		} else if (arg == "--low-latency") {
+			low_latency = true;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--record <input.log>] [--replay <input.log> [--headless]] [--binaural] [--low-latency]" << std::endl;
+			return 1;
+		}
+	}
+	if (headless && replay_filename.empty()) {
+		std::cerr << "--headless only makes sense along with --replay." << std::endl;
+		return 1;
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -61,6 +96,7 @@ int main(int argc, char **argv) {
 		SDL_WINDOW_OPENGL
 		// | SDL_WINDOW_RESIZABLE //uncomment to allow resizing
 		| SDL_WINDOW_ALLOW_HIGHDPI //uncomment for full resolution on high-DPI screens
+		| (headless ? SDL_WINDOW_HIDDEN : 0)
 	);
 
 	//prevent exceedingly tiny windows when resizing:
@@ -96,6 +132,22 @@ int main(int argc, char **argv) {
 
 	//------------ init sound --------------
 	Sound::init();
+	//blocks stay at a safe 1024 frames (the default) unless asked for lower latency; then they halve after each
+	// calm couple of seconds down to 256 (about 5ms) if this machine keeps up (each change reopens the device, and may click):
+	if (low_latency) {
+		Sound::set_adaptive_block_frames(256);
+	}
+	//keep decoded audio around so later runs start faster -- in this user's own folder for the game, since
+	// the folder the game is installed in may not be writable (and shouldn't collect files if it is):
+	if (char *pref_path = SDL_GetPrefPath("Transfer Saga", "Transfer Saga")) {
+		SampleCache::set_disk_cache(std::string(pref_path) + "pcm-cache");
+		SDL_free(pref_path);
+	} else {
+		std::cerr << "NOTE: no folder for cached audio (" << SDL_GetError() << "); decoding it every run." << std::endl;
+	}
+	if (binaural) {
+		Sound::set_binaural(data_path("hrir.hrir"));
+	}
 
 	//------------ load assets --------------
 	call_load_functions();
@@ -123,6 +175,19 @@ int main(int argc, char **argv) {
 	//------------ create game mode + make current --------------
 	Mode::set_current(std::make_shared< StoryMode >());
 
+	//------------ input recording / replay --------------
+	std::unique_ptr< InputRecorder > recorder;
+	if (!record_filename.empty()) {
+		recorder = std::make_unique< InputRecorder >(record_filename);
+		std::cout << "Recording input to '" << record_filename << "'." << std::endl;
+	}
+	std::unique_ptr< InputReplayer > replayer;
+	if (!replay_filename.empty()) {
+		replayer = std::make_unique< InputReplayer >(replay_filename);
+		std::cout << "Replaying input from '" << replay_filename << "'." << std::endl;
+	}
+	auto replay_start = std::chrono::high_resolution_clock::now();
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
@@ -130,7 +195,16 @@ int main(int argc, char **argv) {
 
 		{ //(1) process any events that are pending
 			static SDL_Event evt;
-			while (SDL_PollEvent(&evt) == 1) {
+			if (replayer) {
+				//the player's input is ignored during replay, except for closing the window:
+				while (SDL_PollEvent(&evt) == 1) {
+					if (evt.type == SDL_QUIT) Mode::set_current(nullptr);
+				}
+				if (!Mode::current) break;
+			}
+			while (replayer ? replayer->poll_event(&evt) : SDL_PollEvent(&evt) == 1) {
+				if (recorder) recorder->event(evt);
+
 				//handle resizing:
 				if (evt.type == SDL_WINDOWEVENT && evt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
 					on_resize();
@@ -170,10 +244,21 @@ int main(int argc, char **argv) {
 			//lag to avoid spiral of death:
 			elapsed = std::min(0.1f, elapsed);
 
+			//replay runs on the recorded clock, so it is not affected by how long frames take:
+			if (replayer && !replayer->update(&elapsed)) {
+				Mode::set_current(nullptr);
+				break;
+			}
+			if (recorder) recorder->update(elapsed);
+
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
+
+			Sound::update();
 		}
 
+		if (headless) continue; //nothing to look at, so skip drawing
+
 		{ //(3) call the current mode's "draw" function to produce output:
 		
 			Mode::current->draw(drawable_size);
@@ -183,8 +268,16 @@ int main(int argc, char **argv) {
 		SDL_GL_SwapWindow(window);
 	}
 
+	if (replayer) {
+		float seconds = std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - replay_start).count();
+		std::cout << "Replayed " << replayer->frames << " frames in " << seconds << "s ("
+		          << (replayer->frames ? 1000.0f * seconds / replayer->frames : 0.0f) << "ms per frame)." << std::endl;
+	}
+
 
 	//------------  teardown ------------
+	//how the audio thread kept up this session:
+	Sound::dump_callback_stats(std::cout);
 	Sound::shutdown();
 
 	SDL_GL_DeleteContext(context);
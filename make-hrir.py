@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+
+#create dist/hrir.hrir, the head-related impulse responses used by Sound::set_binaural (see HRTF.hpp for the format),
+# from a simple model of a head: a sphere (for the time difference between the ears and the shadow the head casts,
+# after Brown and Duda, "A Structural Model for Binaural Sound Synthesis", 1998) and a few early echoes from the
+# outer ear (which differ front-to-back, so that sounds behind can be told from sounds in front).
+#Measured HRIRs sound better; to use a set of them, write them out in the same format.
+
+import math
+import struct
+
+RATE = 48000
+LENGTH = 256 #frames per HRIR
+AZIMUTHS = [0.0, 45.0, 90.0, 135.0, 180.0, 225.0, 270.0, 315.0] #virtual speakers, in degrees (0 ahead, 90 right)
+
+HEAD_RADIUS = 0.0875 #meters
+SPEED_OF_SOUND = 343.0 #meters per second
+LEAD = 8 #frames before the earliest arrival (room for the fractional delay filter)
+
+#outer-ear echoes, after Brown and Duda: (strength, delay in frames at 44.1kHz that shrinks toward the back of the head, fixed delay):
+PINNA = [
+	(0.5, 1.0, 2.0),
+	(-1.0, 5.0 * math.sin(0.25 * math.pi), 4.0),
+	(0.5, 5.0 * math.sin(0.25 * math.pi), 7.0),
+	(-0.25, 5.0 * math.sin(0.25 * math.pi), 11.0),
+	(0.25, 5.0 * math.sin(0.25 * math.pi), 13.0),
+]
+
+def delayed_impulse(delay):
+	#windowed-sinc impulse at a fractional 'delay':
+	out = [0.0] * LENGTH
+	center = int(math.floor(delay))
+	for i in range(center - 7, center + 9):
+		if i < 0 or i >= LENGTH: continue
+		x = i - delay
+		sinc = 1.0 if x == 0.0 else math.sin(math.pi * x) / (math.pi * x)
+		window = 0.5 + 0.5 * math.cos(math.pi * x / 8.0) if abs(x) < 8.0 else 0.0
+		out[i] += sinc * window
+	return out
+
+def hrir(azimuth, ear):
+	#angle between the source and the ear (ears point straight left and right):
+	theta = math.acos(max(-1.0, min(1.0, math.cos(math.radians(azimuth - ear)))))
+
+	#extra distance around the head to the ear:
+	if theta < 0.5 * math.pi:
+		delay = HEAD_RADIUS / SPEED_OF_SOUND * (1.0 - math.cos(theta))
+	else:
+		delay = HEAD_RADIUS / SPEED_OF_SOUND * (1.0 + theta - 0.5 * math.pi)
+	signal = delayed_impulse(LEAD + delay * RATE)
+
+	#outer ear echoes (shorter toward the back of the head):
+	facing = math.cos(0.5 * math.radians(((azimuth + 180.0) % 360.0) - 180.0))
+	echoed = list(signal)
+	for (strength, varying, fixed) in PINNA:
+		lag = (varying * facing + fixed) * RATE / 44100.0
+		spread = delayed_impulse(lag)
+		for i in range(LENGTH):
+			if signal[i] == 0.0: continue
+			for j in range(LENGTH - i):
+				if spread[j] != 0.0:
+					echoed[i + j] += strength * signal[i] * spread[j]
+
+	#head shadow: a one-pole, one-zero shelf, brighter facing the source (bilinear transform of Brown and Duda's filter):
+	alpha_min = 0.1
+	theta_min = math.radians(150.0)
+	alpha = (1.0 + 0.5 * alpha_min) + (1.0 - 0.5 * alpha_min) * math.cos(theta / theta_min * math.pi)
+	tau = HEAD_RADIUS / (2.0 * SPEED_OF_SOUND)
+	k = 2.0 * RATE
+	b0 = (1.0 + alpha * tau * k) / (1.0 + tau * k)
+	b1 = (1.0 - alpha * tau * k) / (1.0 + tau * k)
+	a1 = (1.0 - tau * k) / (1.0 + tau * k)
+	out = [0.0] * LENGTH
+	x1 = 0.0
+	y1 = 0.0
+	for i in range(LENGTH):
+		y = b0 * echoed[i] + b1 * x1 - a1 * y1
+		x1 = echoed[i]
+		y1 = y
+		out[i] = y
+
+	#fade out the end:
+	for i in range(LENGTH - 32, LENGTH):
+		out[i] *= 0.5 + 0.5 * math.cos(math.pi * (i - (LENGTH - 32)) / 32.0)
+	return out
+
+def chunk(magic, values):
+	data = struct.pack('<' + 'f' * len(values), *values)
+	return magic.encode('ascii') + struct.pack('<I', len(data)) + data
+
+samples = []
+for azimuth in AZIMUTHS:
+	left = hrir(azimuth, -90.0)
+	right = hrir(azimuth, 90.0)
+	#as loud, overall, as equal-power panning (the two ears' power adds up to one), from every direction:
+	scale = 1.0 / math.sqrt(sum(x * x for x in left) + sum(x * x for x in right))
+	samples += [scale * x for x in left]
+	samples += [scale * x for x in right]
+
+with open('dist/hrir.hrir', 'wb') as f:
+	f.write(chunk('hraz', AZIMUTHS))
+	f.write(chunk('hrir', samples))
+
+print("Wrote " + str(len(AZIMUTHS)) + " pairs of " + str(LENGTH) + "-frame HRIRs to dist/hrir.hrir.")
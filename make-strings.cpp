@@ -0,0 +1,57 @@
+//make-strings builds locale packs (see StringTable.hpp) for the story script.
+// usage:
+//   make-strings export <script> <strings.txt>
+//     writes the script's text, one string per line in text id order, for translating
+//   make-strings pack <strings.txt> <language.strings>
+//     packs a (translated) text file with the same layout into a locale pack;
+//     put the result in dist/locale/ to make it available in game (F2 switches languages)
+
+#include "Story.hpp"
+#include "StringTable.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc != 4 || (std::string(argv[1]) != "export" && std::string(argv[1]) != "pack")) {
+		std::cerr << "Usage:\n\t" << argv[0] << " export <script> <strings.txt>\n\t" << argv[0] << " pack <strings.txt> <language.strings>" << std::endl;
+		return 1;
+	}
+	std::string mode = argv[1];
+
+	std::ifstream in(argv[2], std::ios::binary);
+	if (!in.is_open()) {
+		std::cerr << "Failed to open '" << argv[2] << "'." << std::endl;
+		return 1;
+	}
+	auto source = std::make_shared< std::string >(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+
+	if (mode == "export") {
+		Story story = Story::parse(source);
+		std::ofstream out(argv[3], std::ios::binary);
+		for (auto const &text : story.texts) {
+			out << text << '\n';
+		}
+		if (!out) {
+			std::cerr << "Failed to write '" << argv[3] << "'." << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << story.texts.size() << " strings to '" << argv[3] << "'." << std::endl;
+	} else {
+		std::vector< std::string_view > strings;
+		std::string_view rest(*source);
+		while (!rest.empty()) {
+			size_t end = rest.find('\n');
+			std::string_view line = rest.substr(0, end);
+			rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+			if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+			strings.emplace_back(line);
+		}
+		StringTable::write(argv[3], strings);
+		std::cout << "Packed " << strings.size() << " strings into '" << argv[3] << "'." << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,370 @@
+//mix-bench measures the mixer's inner loop: how many looping voices can be mixed into a
+// 1024-frame stereo block per millisecond, using the original one-frame-at-a-time loop ("before")
+// and each mix kernel this CPU supports; then the same for resampled (rate != 1) voices,
+// for computing the voices' 3D panning (per voice with std::sin/cos, "before", vs. the pan kernels),
+// for the complex multiply-adds of binaural filtering (see HRTF.hpp), and for mixing 16-bit samples
+// (int16 and half; see Sound::Sample::Storage) rather than float ones.
+// usage: mix-bench [voices]
+
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr uint32_t const MIX_SAMPLES = 1024; //same block size as Sound.cpp
+
+struct Voice {
+	std::vector< float > data;
+	std::vector< int16_t > data_int16; //(the same samples, for the 16-bit kernels)
+	std::vector< uint16_t > data_half;
+	uint32_t i = 0;
+	float left = 0.0f, right = 0.0f; //gains at start of block
+	float left_step = 0.0f, right_step = 0.0f;
+};
+
+//the mix_audio inner loop as it was before the kernels (per-frame wraparound check and pan update):
+static void mix_before(Voice &voice, float *buffer) {
+	float const *data = voice.data.data();
+	uint32_t const size = uint32_t(voice.data.size());
+	uint32_t i = voice.i;
+	float l = voice.left, r = voice.right;
+	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+		buffer[2*s+0] += l * data[i];
+		buffer[2*s+1] += r * data[i];
+		i += 1;
+		if (i == size) i = 0;
+		l += voice.left_step;
+		r += voice.right_step;
+	}
+	voice.i = i;
+}
+
+//the mix_audio inner loop as it is now (contiguous runs of 'data' -- one of the voice's copies of its samples -- handed to a kernel):
+template< typename Kernel, typename Sample >
+static void mix_runs(Kernel kernel, std::vector< Sample > const &samples, Voice &voice, float *buffer) {
+	Sample const *data = samples.data();
+	uint32_t const size = uint32_t(samples.size());
+	uint32_t i = voice.i;
+	for (uint32_t s = 0; s < MIX_SAMPLES; /* later */) {
+		uint32_t run = std::min(MIX_SAMPLES - s, size - i);
+		kernel(data + i, run, buffer + 2*s,
+			voice.left + s * voice.left_step, voice.right + s * voice.right_step,
+			voice.left_step, voice.right_step);
+		s += run;
+		i += run;
+		if (i == size) i = 0;
+	}
+	voice.i = i;
+}
+
+//resampled playback at 'rate' (wrapping around early enough that the filter taps stay inside the data,
+// which is close enough to what the mixer does for timing purposes):
+template< typename Kernel, typename Sample >
+static void resample_runs(Kernel kernel, std::vector< Sample > const &samples, float const *filter, float rate, Voice &voice, float *buffer) {
+	uint32_t const size = uint32_t(samples.size());
+	uint64_t const step = uint64_t(double(rate) * 4294967296.0);
+	uint64_t const first = uint64_t(RESAMPLE_TAPS / 2 - 1) << 32;
+	uint64_t const last = (uint64_t(size - RESAMPLE_TAPS / 2 - 1) << 32) | 0xffffffffULL;
+	uint64_t position = std::max(first, uint64_t(voice.i) << 32);
+	for (uint32_t s = 0; s < MIX_SAMPLES; /* later */) {
+		if (position > last) position = first;
+		uint32_t run = uint32_t(std::min< uint64_t >(MIX_SAMPLES - s, (last - position) / step + 1));
+		kernel(samples.data(), position, step, run, filter, buffer + 2*s,
+			voice.left + s * voice.left_step, voice.right + s * voice.right_step,
+			voice.left_step, voice.right_step);
+		position += run * step;
+		s += run;
+	}
+	voice.i = uint32_t(position >> 32);
+}
+
+//3D panning as mix_audio did it before the pan kernels (once per voice, at both ends of the block):
+static void pan_before(uint32_t count, float const *x, float const *y, float const *z, float const *radius,
+	float const listener[3], float const listener_right[3], float *attenuation, float *left, float *right) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float tx = x[i] - listener[0], ty = y[i] - listener[1], tz = z[i] - listener[2];
+		float distance = std::sqrt(tx * tx + ty * ty + tz * tz);
+		float amt = (listener_right[0] * tx + listener_right[1] * ty + listener_right[2] * tz) / distance;
+		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
+		attenuation[i] = 1.0f / (1.0f + (distance / radius[i]));
+		left[i] = std::cos(ang) * attenuation[i];
+		right[i] = std::sin(ang) * attenuation[i];
+	}
+}
+
+template< typename F >
+static double bench(std::string const &label, std::vector< Voice > &voices, std::vector< float > &buffer, F const &mix, double baseline) {
+	uint32_t const blocks = std::max< uint32_t >(20, 200000 / uint32_t(voices.size()));
+	double best = std::numeric_limits< double >::infinity();
+	for (uint32_t rep = 0; rep < 5; ++rep) {
+		for (auto &v : voices) v.i = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t b = 0; b < blocks; ++b) {
+			std::fill(buffer.begin(), buffer.end(), 0.0f);
+			for (auto &v : voices) mix(v, buffer.data());
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration< double >(end - start).count() / blocks);
+	}
+
+	double voices_per_ms = double(voices.size()) / (best * 1000.0);
+	std::cout << std::setw(8) << label
+		<< std::setw(12) << std::fixed << std::setprecision(1) << best * 1.0e6 << " us/block"
+		<< std::setw(12) << std::setprecision(0) << voices_per_ms << " voices/ms";
+	if (baseline > 0.0) std::cout << std::setw(8) << std::setprecision(2) << voices_per_ms / baseline << "x";
+	std::cout << std::endl;
+	return voices_per_ms;
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = 256;
+	if (argc > 1) count = uint32_t(std::max(1, std::atoi(argv[1])));
+
+	//voices looping samples of assorted lengths (some short enough to wrap every block), with moving pans:
+	std::mt19937 mt(0x5eed);
+	std::vector< Voice > voices(count);
+	for (auto &v : voices) {
+		v.data.resize(std::uniform_int_distribution< uint32_t >(500, 48000)(mt));
+		for (auto &x : v.data) x = std::uniform_real_distribution< float >(-1.0f, 1.0f)(mt);
+		v.left = std::uniform_real_distribution< float >(0.0f, 1.0f)(mt);
+		v.right = std::uniform_real_distribution< float >(0.0f, 1.0f)(mt);
+		v.left_step = (std::uniform_real_distribution< float >(0.0f, 1.0f)(mt) - v.left) / MIX_SAMPLES;
+		v.right_step = (std::uniform_real_distribution< float >(0.0f, 1.0f)(mt) - v.right) / MIX_SAMPLES;
+	}
+	std::vector< float > buffer(2 * MIX_SAMPLES);
+
+	std::cout << count << " voices, " << MIX_SAMPLES << " frames per block; mixer uses '" << mix_kernel_name << "'." << std::endl;
+
+	double before = bench("before", voices, buffer, mix_before, 0.0);
+	std::vector< float > reference = buffer;
+
+	struct { char const *name; MixKernel kernel; } kernels[] = {
+		{"scalar", mix_kernel_scalar},
+		{"sse2", mix_kernel_sse2},
+		{"avx2", mix_kernel_avx2},
+	};
+	for (auto const &k : kernels) {
+		if (!k.kernel) {
+			std::cout << std::setw(8) << k.name << "  (not supported)" << std::endl;
+			continue;
+		}
+		bench(k.name, voices, buffer, [&](Voice &v, float *out){ mix_runs(k.kernel, v.data, v, out); }, before);
+
+		//sanity check: same result as the original loop (up to rounding in the gain ramps):
+		float max_error = 0.0f;
+		for (uint32_t s = 0; s < buffer.size(); ++s) {
+			max_error = std::max(max_error, std::abs(buffer[s] - reference[s]));
+		}
+		if (max_error > 1.0e-3f * float(count)) {
+			std::cerr << "  '" << k.name << "' differs from the original loop by " << max_error << "!" << std::endl;
+			return 1;
+		}
+	}
+
+	//resampling, at a rate typical of pitch variation:
+	float const rate = 1.1f;
+	std::vector< float > filter(RESAMPLE_PHASES * RESAMPLE_TAPS);
+	make_resample_filter(0.9f / 1.5f, filter.data());
+
+	std::cout << "resampling at rate " << rate << ":" << std::endl;
+	struct { char const *name; ResampleKernel kernel; } resample_kernels[] = {
+		{"scalar", resample_kernel_scalar},
+		{"sse2", resample_kernel_sse2},
+		{"avx2", resample_kernel_avx2},
+	};
+	double resample_baseline = 0.0;
+	for (auto const &k : resample_kernels) {
+		if (!k.kernel) {
+			std::cout << std::setw(8) << k.name << "  (not supported)" << std::endl;
+			continue;
+		}
+		double result = bench(k.name, voices, buffer, [&](Voice &v, float *out){ resample_runs(k.kernel, v.data, filter.data(), rate, v, out); }, resample_baseline);
+		if (resample_baseline == 0.0) resample_baseline = result;
+	}
+
+	//16-bit samples, against the same voices' float samples with the same kind of kernel
+	// (so that each ratio is the cost of widening alone, not the difference between instruction sets):
+	size_t float_bytes = 0, narrow_bytes = 0;
+	for (auto &v : voices) {
+		v.data_int16.resize(v.data.size());
+		v.data_half.resize(v.data.size());
+		for (size_t i = 0; i < v.data.size(); ++i) {
+			v.data_int16[i] = float_to_int16(v.data[i]);
+			v.data_half[i] = float_to_half(v.data[i]);
+		}
+		float_bytes += v.data.size() * sizeof(float);
+		narrow_bytes += v.data.size() * sizeof(int16_t);
+	}
+	std::cout << "16-bit samples (" << narrow_bytes / 1024 << " KiB of samples rather than " << float_bytes / 1024 << " KiB):" << std::endl;
+	struct { char const *name; MixKernel mix; MixKernelInt16 int16; MixKernelHalf half; } narrow_kernels[] = {
+		{"scalar", mix_kernel_scalar, mix_int16_kernel_scalar, mix_half_kernel_scalar},
+		{"sse2", mix_kernel_sse2, mix_int16_kernel_sse2, mix_half_kernel_sse2},
+		{"avx2", mix_kernel_avx2, mix_int16_kernel_avx2, mix_half_kernel_avx2},
+	};
+	for (auto const &k : narrow_kernels) {
+		std::cout << " " << k.name << ":" << std::endl;
+		if (!k.mix || !k.int16 || !k.half) {
+			std::cout << std::setw(8) << "" << "  (not supported)" << std::endl;
+			continue;
+		}
+		double float_baseline = bench("float", voices, buffer, [&](Voice &v, float *out){ mix_runs(k.mix, v.data, v, out); }, 0.0);
+		reference = buffer;
+		for (uint32_t format = 0; format < 2; ++format) {
+			if (format == 0) bench("int16", voices, buffer, [&](Voice &v, float *out){ mix_runs(k.int16, v.data_int16, v, out); }, float_baseline);
+			else bench("half", voices, buffer, [&](Voice &v, float *out){ mix_runs(k.half, v.data_half, v, out); }, float_baseline);
+
+			//sanity check: same result as the float samples (up to the 16-bit formats' rounding):
+			float max_error = 0.0f;
+			for (uint32_t s = 0; s < buffer.size(); ++s) {
+				max_error = std::max(max_error, std::abs(buffer[s] - reference[s]));
+			}
+			if (max_error > 1.0e-3f * float(count)) {
+				std::cerr << "  '" << k.name << "' differs from mixing float samples by " << max_error << "!" << std::endl;
+				return 1;
+			}
+		}
+	}
+	std::cout << "...resampled at rate " << rate << ":" << std::endl;
+	struct { char const *name; ResampleKernel resample; ResampleKernelInt16 int16; ResampleKernelHalf half; } narrow_resample_kernels[] = {
+		{"scalar", resample_kernel_scalar, resample_int16_kernel_scalar, resample_half_kernel_scalar},
+		{"sse2", resample_kernel_sse2, resample_int16_kernel_sse2, resample_half_kernel_sse2},
+		{"avx2", resample_kernel_avx2, resample_int16_kernel_avx2, resample_half_kernel_avx2},
+	};
+	for (auto const &k : narrow_resample_kernels) {
+		std::cout << " " << k.name << ":" << std::endl;
+		if (!k.resample || !k.int16 || !k.half) {
+			std::cout << std::setw(8) << "" << "  (not supported)" << std::endl;
+			continue;
+		}
+		double resample_float = bench("float", voices, buffer, [&](Voice &v, float *out){ resample_runs(k.resample, v.data, filter.data(), rate, v, out); }, 0.0);
+		bench("int16", voices, buffer, [&](Voice &v, float *out){ resample_runs(k.int16, v.data_int16, filter.data(), rate, v, out); }, resample_float);
+		bench("half", voices, buffer, [&](Voice &v, float *out){ resample_runs(k.half, v.data_half, filter.data(), rate, v, out); }, resample_float);
+	}
+
+	//3D panning of every voice, at the start and end of a block:
+	std::vector< float > x(count), y(count), z(count), radius(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		x[i] = std::uniform_real_distribution< float >(-10.0f, 10.0f)(mt);
+		y[i] = std::uniform_real_distribution< float >(-10.0f, 10.0f)(mt);
+		z[i] = std::uniform_real_distribution< float >(-2.0f, 2.0f)(mt);
+		radius[i] = std::uniform_real_distribution< float >(1.0f, 10.0f)(mt);
+	}
+	std::vector< float > attenuation(count), left(count), right(count);
+	std::vector< float > reference_left(count), reference_right(count);
+	float const listener[2][3] = {{0.0f, 0.0f, 0.0f}, {0.1f, 0.0f, 0.0f}};
+	float const listener_right[3] = {1.0f, 0.0f, 0.0f};
+
+	std::cout << "3D panning:" << std::endl;
+	struct { char const *name; PanKernel kernel; } pan_kernels[] = {
+		{"before", pan_before},
+		{"scalar", pan_kernel_scalar},
+		{"sse2", pan_kernel_sse2},
+		{"avx2", pan_kernel_avx2},
+	};
+	double pan_baseline = 0.0;
+	for (auto const &k : pan_kernels) {
+		if (!k.kernel) {
+			std::cout << std::setw(8) << k.name << "  (not supported)" << std::endl;
+			continue;
+		}
+		uint32_t const blocks = std::max< uint32_t >(200, 2000000 / count);
+		double best = std::numeric_limits< double >::infinity();
+		for (uint32_t rep = 0; rep < 5; ++rep) {
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				for (auto const &at : listener) {
+					k.kernel(count, x.data(), y.data(), z.data(), radius.data(), at, listener_right, attenuation.data(), left.data(), right.data());
+				}
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration< double >(end - start).count() / blocks);
+		}
+		double voices_per_ms = double(count) / (best * 1000.0);
+		std::cout << std::setw(8) << k.name
+			<< std::setw(12) << std::fixed << std::setprecision(2) << best * 1.0e6 << " us/block"
+			<< std::setw(12) << std::setprecision(0) << voices_per_ms << " voices/ms";
+		if (pan_baseline > 0.0) std::cout << std::setw(8) << std::setprecision(2) << voices_per_ms / pan_baseline << "x";
+		std::cout << std::endl;
+
+		if (pan_baseline == 0.0) {
+			pan_baseline = voices_per_ms;
+			reference_left = left;
+			reference_right = right;
+		} else {
+			//sanity check: same gains as std::sin/cos (up to the polynomials' error):
+			float max_error = 0.0f;
+			for (uint32_t i = 0; i < count; ++i) {
+				max_error = std::max(max_error, std::max(std::abs(left[i] - reference_left[i]), std::abs(right[i] - reference_right[i])));
+			}
+			if (max_error > 1.0e-5f) {
+				std::cerr << "  '" << k.name << "' pans differently than std::sin/cos by " << max_error << "!" << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	//binaural filtering of one bus, per 128-frame step: 8 virtual speakers, 2 ears, 2 partitions of 129 bins each:
+	constexpr uint32_t const BINS = 129;
+	constexpr uint32_t const PRODUCTS = 8 * 2 * 2;
+	std::vector< float > spectra(PRODUCTS * 4 * BINS);
+	for (auto &f : spectra) f = std::uniform_real_distribution< float >(-1.0f, 1.0f)(mt);
+	std::vector< float > acc(2 * BINS), reference_acc(2 * BINS);
+
+	std::cout << "spectrum multiply-add (" << PRODUCTS << " products of " << BINS << " bins per step):" << std::endl;
+	struct { char const *name; SpectrumKernel kernel; } spectrum_kernels[] = {
+		{"scalar", spectrum_kernel_scalar},
+		{"sse2", spectrum_kernel_sse2},
+		{"avx2", spectrum_kernel_avx2},
+	};
+	double spectrum_baseline = 0.0;
+	for (auto const &k : spectrum_kernels) {
+		if (!k.kernel) {
+			std::cout << std::setw(8) << k.name << "  (not supported)" << std::endl;
+			continue;
+		}
+		uint32_t const steps = 20000;
+		double best = std::numeric_limits< double >::infinity();
+		for (uint32_t rep = 0; rep < 5; ++rep) {
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t step = 0; step < steps; ++step) {
+				std::fill(acc.begin(), acc.end(), 0.0f);
+				for (uint32_t p = 0; p < PRODUCTS; ++p) {
+					float const *a = spectra.data() + p * 4 * BINS;
+					float const *b = a + 2 * BINS;
+					k.kernel(BINS, a, a + BINS, b, b + BINS, acc.data(), acc.data() + BINS);
+				}
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration< double >(end - start).count() / steps);
+		}
+		std::cout << std::setw(8) << k.name
+			<< std::setw(12) << std::fixed << std::setprecision(2) << best * 1.0e6 << " us/step";
+		if (spectrum_baseline > 0.0) std::cout << std::setw(8) << std::setprecision(2) << spectrum_baseline / best << "x";
+		std::cout << std::endl;
+
+		if (spectrum_baseline == 0.0) {
+			spectrum_baseline = best;
+			reference_acc = acc;
+		} else {
+			//sanity check: same sums as the scalar kernel (up to rounding):
+			float max_error = 0.0f;
+			for (uint32_t i = 0; i < 2 * BINS; ++i) {
+				max_error = std::max(max_error, std::abs(acc[i] - reference_acc[i]));
+			}
+			if (max_error > 1.0e-4f) {
+				std::cerr << "  '" << k.name << "' multiplies differently than 'scalar' by " << max_error << "!" << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,688 @@
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MIX_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//gcc and clang need to be told that a function may use AVX2 instructions (and F16C's half-float conversions,
+// which every CPU with AVX2 also has); MSVC allows intrinsics for any instruction set anywhere:
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#else
+#define TARGET_AVX2
+#endif
+
+int16_t float_to_int16(float value) {
+	float scaled = std::min(std::max(value * 32768.0f, -32768.0f), 32767.0f);
+	return int16_t(std::lrint(scaled));
+}
+
+float int16_to_float(int16_t value) {
+	return float(value) * (1.0f / 32768.0f);
+}
+
+uint16_t float_to_half(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, 4);
+	uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+	bits &= 0x7fffffff;
+	if (bits > 0x7f800000) return 0; //NaN (stored as silence, so stored halves are always finite)
+	if (bits >= 0x477ff000) return sign | 0x7bff; //(would round to infinity)
+	if (bits < 0x38800000) {
+		//too small for a normal half, so a multiple of 2^-24 (exact, then rounded to nearest even):
+		float magnitude;
+		std::memcpy(&magnitude, &bits, 4);
+		return sign | uint16_t(std::lrint(magnitude * 16777216.0f));
+	}
+	//rebias the exponent and round the mantissa from 23 bits to 10 (to nearest even; a carry bumps the exponent):
+	bits -= (127 - 15) << 23;
+	bits += 0xfff + ((bits >> 13) & 1);
+	return sign | uint16_t(bits >> 13);
+}
+
+//(the SIMD kernels below widen every finite half in exactly the same way)
+float half_to_float(uint16_t value) {
+	uint32_t sign = uint32_t(value & 0x8000) << 16;
+	uint32_t magnitude = value & 0x7fff;
+	uint32_t bits;
+	if (magnitude < 0x0400) {
+		//zero or subnormal: a multiple of 2^-24:
+		float small = float(magnitude) * (1.0f / 16777216.0f);
+		std::memcpy(&bits, &small, 4);
+	} else {
+		//move exponent and mantissa into place and rebias the exponent (twice, for infinity and NaN):
+		bits = (magnitude << 13) + ((127 - 15) << 23);
+		if (magnitude >= 0x7c00) bits += (128 - 16) << 23;
+	}
+	bits |= sign;
+	float result;
+	std::memcpy(&result, &bits, 4);
+	return result;
+}
+
+//Every kernel is written once for all three sample formats (float, int16, half),
+// reading through these overloads, which widen to float:
+static inline float sample(float const *src, uint32_t i) { return src[i]; }
+static inline float sample(int16_t const *src, uint32_t i) { return float(src[i]); }
+static inline float sample(uint16_t const *src, uint32_t i) { return half_to_float(src[i]); }
+
+//int16 samples are read as whole numbers; their 1/32768 is folded into the gains when a kernel starts
+// instead (exact, since it is a power of two, and it saves a multiply per sample):
+static inline float gain_scale(float const *) { return 1.0f; }
+static inline float gain_scale(int16_t const *) { return 1.0f / 32768.0f; }
+static inline float gain_scale(uint16_t const *) { return 1.0f; }
+
+//helper: mix_scalar with gains that are already scaled (for the SIMD kernels' leftover frames):
+template< typename Sample >
+static void mix_scalar_scaled(Sample const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	for (uint32_t s = 0; s < count; ++s) {
+		float value = sample(src, s);
+		dst[2*s+0] += left * value;
+		dst[2*s+1] += right * value;
+		left += left_step;
+		right += right_step;
+	}
+}
+
+template< typename Sample >
+static void mix_scalar(Sample const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	float scale = gain_scale(src);
+	mix_scalar_scaled(src, count, dst, scale * left, scale * right, scale * left_step, scale * right_step);
+}
+
+static void stereo_scalar(float const *src, uint32_t count, float *dst, float gain, float gain_step) {
+	for (uint32_t s = 0; s < count; ++s) {
+		dst[2*s+0] += gain * src[2*s+0];
+		dst[2*s+1] += gain * src[2*s+1];
+		gain += gain_step;
+	}
+}
+
+//helper: which 'filter' coefficients (and 'src' values) go with position 'position':
+static inline float const *filter_phase(float const *filter, uint64_t position) {
+	return filter + (uint32_t(position) >> (32 - RESAMPLE_PHASE_BITS)) * RESAMPLE_TAPS;
+}
+template< typename Sample >
+static inline Sample const *first_tap(Sample const *src, uint64_t position) {
+	return src + uint32_t(position >> 32) - (RESAMPLE_TAPS / 2 - 1);
+}
+
+template< typename Sample >
+static void resample_scalar(Sample const *src, uint64_t position, uint64_t step, uint32_t count, float const *filter, float *dst, float left, float right, float left_step, float right_step) {
+	float scale = gain_scale(src);
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+	for (uint32_t s = 0; s < count; ++s) {
+		Sample const *x = first_tap(src, position);
+		float const *c = filter_phase(filter, position);
+		float value = 0.0f;
+		for (uint32_t k = 0; k < RESAMPLE_TAPS; ++k) {
+			value += sample(x, k) * c[k];
+		}
+		dst[2*s+0] += left * value;
+		dst[2*s+1] += right * value;
+		left += left_step;
+		right += right_step;
+		position += step;
+	}
+}
+
+//polynomial coefficients for sin and cos on [-pi/4, pi/4] (Taylor series; error below 4e-7 there):
+constexpr float const SIN3 = -1.0f / 6.0f, SIN5 = 1.0f / 120.0f, SIN7 = -1.0f / 5040.0f;
+constexpr float const COS2 = -1.0f / 2.0f, COS4 = 1.0f / 24.0f, COS6 = -1.0f / 720.0f, COS8 = 1.0f / 40320.0f;
+constexpr float const QUARTER_PI = 0.78539816f;
+constexpr float const SQRT_HALF = 0.70710678f;
+constexpr float const SQRT_TWO = 1.41421356f;
+
+//Every pan kernel works the same way: a = pi/4 + t, with t = (pi/4) * amount in [-pi/4, pi/4], so
+//  cos(a) = (cos(t) - sin(t)) * sqrt(1/2) and sin(a) = (cos(t) + sin(t)) * sqrt(1/2),
+//  and sin(t), cos(t) only need polynomials on a small range.
+static void pan_scalar(uint32_t count, float const *x, float const *y, float const *z, float const *radius,
+	float const listener[3], float const listener_right[3], float *attenuation, float *left, float *right) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float tx = x[i] - listener[0];
+		float ty = y[i] - listener[1];
+		float tz = z[i] - listener[2];
+		float distance = std::sqrt(tx * tx + ty * ty + tz * tz);
+		if (distance == 0.0f) {
+			attenuation[i] = 1.0f;
+			left[i] = right[i] = SQRT_TWO;
+			continue;
+		}
+		float amount = (listener_right[0] * tx + listener_right[1] * ty + listener_right[2] * tz) / distance;
+		amount = std::max(-1.0f, std::min(1.0f, amount));
+		float t = QUARTER_PI * amount;
+		float t2 = t * t;
+		float sin_t = t * (1.0f + t2 * (SIN3 + t2 * (SIN5 + t2 * SIN7)));
+		float cos_t = 1.0f + t2 * (COS2 + t2 * (COS4 + t2 * (COS6 + t2 * COS8)));
+		float att = 1.0f / (1.0f + distance / radius[i]);
+		attenuation[i] = att;
+		left[i] = (cos_t - sin_t) * (SQRT_HALF * att);
+		right[i] = (cos_t + sin_t) * (SQRT_HALF * att);
+	}
+}
+
+static void spectrum_scalar(uint32_t count, float const *a_re, float const *a_im, float const *b_re, float const *b_im, float *acc_re, float *acc_im) {
+	for (uint32_t i = 0; i < count; ++i) {
+		acc_re[i] += a_re[i] * b_re[i] - a_im[i] * b_im[i];
+		acc_im[i] += a_re[i] * b_im[i] + a_im[i] * b_re[i];
+	}
+}
+
+void make_resample_filter(float cutoff, float *filter) {
+	constexpr double const Pi = 3.14159265358979323846;
+	for (uint32_t p = 0; p < RESAMPLE_PHASES; ++p) {
+		double frac = double(p) / double(RESAMPLE_PHASES);
+		double sum = 0.0;
+		for (uint32_t k = 0; k < RESAMPLE_TAPS; ++k) {
+			//distance from the interpolated position to tap k:
+			double t = (double(k) - double(RESAMPLE_TAPS / 2 - 1)) - frac;
+			double x = Pi * cutoff * t;
+			double sinc = (x == 0.0 ? 1.0 : std::sin(x) / x);
+			//Blackman window spanning the taps:
+			double w = 0.5 + t / double(RESAMPLE_TAPS);
+			double window = (w <= 0.0 || w >= 1.0 ? 0.0 : 0.42 - 0.5 * std::cos(2.0 * Pi * w) + 0.08 * std::cos(4.0 * Pi * w));
+			filter[p * RESAMPLE_TAPS + k] = float(sinc * window);
+			sum += sinc * window;
+		}
+		//normalize so that every phase passes a constant signal unchanged:
+		for (uint32_t k = 0; k < RESAMPLE_TAPS; ++k) {
+			filter[p * RESAMPLE_TAPS + k] = float(filter[p * RESAMPLE_TAPS + k] / sum);
+		}
+	}
+}
+
+#ifdef MIX_KERNELS_X86
+
+//SSE2 is part of every x86-64 CPU (and every x86 CPU this game will meet).
+
+//helpers: four 16-bit samples (one in each 32-bit lane), widened to float:
+static inline __m128 widen_int16(__m128i in) {
+	//(the samples are in the top halves of the lanes, and are sign-extended down)
+	return _mm_cvtepi32_ps(_mm_srai_epi32(in, 16)); //(whole numbers; see gain_scale)
+}
+static inline __m128 widen_half(__m128i in) {
+	//(the halves are in the bottom halves of the lanes, zero-extended)
+	//SSE2 has no half-float conversion, so this is half_to_float, four at a time, for finite halves only
+	// (which is all float_to_half makes): rebias the exponent; a subnormal is rebiased as if its exponent
+	// were 1 and then has that implicit leading 2^-14 taken off again (exact, since the two are within a factor of two):
+	__m128i magnitude = _mm_and_si128(in, _mm_set1_epi32(0x7fff));
+	__m128i sign = _mm_slli_epi32(_mm_xor_si128(in, magnitude), 16);
+	__m128i small = _mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x0400));
+	__m128i bits = _mm_add_epi32(_mm_slli_epi32(magnitude, 13), _mm_set1_epi32((127 - 15) << 23));
+	bits = _mm_add_epi32(bits, _mm_and_si128(small, _mm_set1_epi32(1 << 23)));
+	__m128 value = _mm_sub_ps(_mm_castsi128_ps(bits), _mm_and_ps(_mm_castsi128_ps(small), _mm_set1_ps(1.0f / 16384.0f)));
+	return _mm_or_ps(value, _mm_castsi128_ps(sign));
+}
+
+//helpers: eight samples from 'src', widened to float (one 16-byte load for the 16-bit formats):
+static inline void load8(float const *src, __m128 &lo, __m128 &hi) {
+	lo = _mm_loadu_ps(src);
+	hi = _mm_loadu_ps(src + 4);
+}
+static inline void load8(int16_t const *src, __m128 &lo, __m128 &hi) {
+	__m128i in = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src));
+	lo = widen_int16(_mm_unpacklo_epi16(in, in));
+	hi = widen_int16(_mm_unpackhi_epi16(in, in));
+}
+static inline void load8(uint16_t const *src, __m128 &lo, __m128 &hi) {
+	__m128i in = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src));
+	lo = widen_half(_mm_unpacklo_epi16(in, _mm_setzero_si128()));
+	hi = widen_half(_mm_unpackhi_epi16(in, _mm_setzero_si128()));
+}
+
+template< typename Sample >
+static void mix_sse2(Sample const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	float scale = gain_scale(src);
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+
+	//gains for frames s, s+1 as (L R L R); frames s+2, s+3 are one 'step' further along:
+	__m128 gain = _mm_setr_ps(left, right, left + left_step, right + right_step);
+	__m128 step = _mm_setr_ps(2.0f * left_step, 2.0f * right_step, 2.0f * left_step, 2.0f * right_step);
+	__m128 step2 = _mm_add_ps(step, step);
+
+	uint32_t s = 0;
+	for (; s + 8 <= count; s += 8) {
+		__m128 in[2];
+		load8(src + s, in[0], in[1]); //a b c d, e f g h
+		for (uint32_t half = 0; half < 2; ++half) {
+			float *out = dst + 2*s + 8*half;
+			__m128 lo = _mm_unpacklo_ps(in[half], in[half]); //a a b b
+			__m128 hi = _mm_unpackhi_ps(in[half], in[half]); //c c d d
+			__m128 out0 = _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(gain, lo));
+			__m128 out1 = _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(_mm_add_ps(gain, step), hi));
+			_mm_storeu_ps(out, out0);
+			_mm_storeu_ps(out + 4, out1);
+			gain = _mm_add_ps(gain, step2);
+		}
+	}
+
+	//leftover frames:
+	mix_scalar_scaled(src + s, count - s, dst + 2*s, left + s * left_step, right + s * right_step, left_step, right_step);
+}
+
+static void stereo_sse2(float const *src, uint32_t count, float *dst, float gain, float gain_step) {
+	//gains for frames s, s+1 as (g0 g0 g1 g1):
+	__m128 g = _mm_setr_ps(gain, gain, gain + gain_step, gain + gain_step);
+	__m128 step = _mm_set1_ps(2.0f * gain_step);
+
+	uint32_t s = 0;
+	for (; s + 2 <= count; s += 2) {
+		__m128 out = _mm_add_ps(_mm_loadu_ps(dst + 2*s), _mm_mul_ps(g, _mm_loadu_ps(src + 2*s)));
+		_mm_storeu_ps(dst + 2*s, out);
+		g = _mm_add_ps(g, step);
+	}
+
+	//leftover frame:
+	stereo_scalar(src + 2*s, count - s, dst + 2*s, gain + s * gain_step, gain_step);
+}
+
+template< typename Sample >
+static void resample_sse2(Sample const *src, uint64_t position, uint64_t step, uint32_t count, float const *filter, float *dst, float left, float right, float left_step, float right_step) {
+	static_assert(RESAMPLE_TAPS == 16, "kernel is written for 16 taps");
+	float scale = gain_scale(src);
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+	for (uint32_t s = 0; s < count; ++s) {
+		Sample const *x = first_tap(src, position);
+		float const *c = filter_phase(filter, position);
+		__m128 in[4];
+		load8(x, in[0], in[1]);
+		load8(x + 8, in[2], in[3]);
+		__m128 sum = _mm_mul_ps(in[0], _mm_loadu_ps(c));
+		sum = _mm_add_ps(sum, _mm_mul_ps(in[1], _mm_loadu_ps(c + 4)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(in[2], _mm_loadu_ps(c + 8)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(in[3], _mm_loadu_ps(c + 12)));
+		//horizontal sum:
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		//value in both lanes, times (left, right) gains:
+		__m128 value = _mm_shuffle_ps(sum, sum, 0);
+		__m128 out = _mm_castpd_ps(_mm_load_sd(reinterpret_cast< double const * >(dst + 2*s)));
+		out = _mm_add_ps(out, _mm_mul_ps(value, _mm_setr_ps(left, right, 0.0f, 0.0f)));
+		_mm_store_sd(reinterpret_cast< double * >(dst + 2*s), _mm_castps_pd(out));
+		left += left_step;
+		right += right_step;
+		position += step;
+	}
+}
+
+//helpers: eight samples from 'src', widened to float:
+TARGET_AVX2
+static inline __m256 load8(float const *src) {
+	return _mm256_loadu_ps(src);
+}
+TARGET_AVX2
+static inline __m256 load8(int16_t const *src) {
+	__m256i wide = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast< __m128i const * >(src)));
+	return _mm256_cvtepi32_ps(wide); //(whole numbers; see gain_scale)
+}
+TARGET_AVX2
+static inline __m256 load8(uint16_t const *src) {
+	return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast< __m128i const * >(src)));
+}
+
+template< typename Sample >
+TARGET_AVX2
+static void resample_avx2(Sample const *src, uint64_t position, uint64_t step, uint32_t count, float const *filter, float *dst, float left, float right, float left_step, float right_step) {
+	static_assert(RESAMPLE_TAPS == 16, "kernel is written for 16 taps");
+	float scale = gain_scale(src);
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+	for (uint32_t s = 0; s < count; ++s) {
+		Sample const *x = first_tap(src, position);
+		float const *c = filter_phase(filter, position);
+		__m256 sum8 = _mm256_mul_ps(load8(x), _mm256_loadu_ps(c));
+		sum8 = _mm256_add_ps(sum8, _mm256_mul_ps(load8(x + 8), _mm256_loadu_ps(c + 8)));
+		//horizontal sum:
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		//value in both lanes, times (left, right) gains:
+		__m128 value = _mm_shuffle_ps(sum, sum, 0);
+		__m128 out = _mm_castpd_ps(_mm_load_sd(reinterpret_cast< double const * >(dst + 2*s)));
+		out = _mm_add_ps(out, _mm_mul_ps(value, _mm_setr_ps(left, right, 0.0f, 0.0f)));
+		_mm_store_sd(reinterpret_cast< double * >(dst + 2*s), _mm_castps_pd(out));
+		left += left_step;
+		right += right_step;
+		position += step;
+	}
+	_mm256_zeroupper();
+}
+
+static void pan_sse2(uint32_t count, float const *x, float const *y, float const *z, float const *radius,
+	float const listener[3], float const listener_right[3], float *attenuation, float *left, float *right) {
+	__m128 const lx = _mm_set1_ps(listener[0]), ly = _mm_set1_ps(listener[1]), lz = _mm_set1_ps(listener[2]);
+	__m128 const rx = _mm_set1_ps(listener_right[0]), ry = _mm_set1_ps(listener_right[1]), rz = _mm_set1_ps(listener_right[2]);
+	__m128 const zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), minus_one = _mm_set1_ps(-1.0f);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 tx = _mm_sub_ps(_mm_loadu_ps(x + i), lx);
+		__m128 ty = _mm_sub_ps(_mm_loadu_ps(y + i), ly);
+		__m128 tz = _mm_sub_ps(_mm_loadu_ps(z + i), lz);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+		__m128 at_listener = _mm_cmpeq_ps(distance, zero);
+
+		//(lanes at the listener divide by zero here, but are replaced below)
+		__m128 amount = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, tx), _mm_mul_ps(ry, ty)), _mm_mul_ps(rz, tz)), distance);
+		amount = _mm_min_ps(_mm_max_ps(amount, minus_one), one);
+		__m128 t = _mm_mul_ps(_mm_set1_ps(QUARTER_PI), amount);
+		__m128 t2 = _mm_mul_ps(t, t);
+		__m128 sin_t = _mm_add_ps(_mm_set1_ps(SIN5), _mm_mul_ps(t2, _mm_set1_ps(SIN7)));
+		sin_t = _mm_add_ps(_mm_set1_ps(SIN3), _mm_mul_ps(t2, sin_t));
+		sin_t = _mm_mul_ps(t, _mm_add_ps(one, _mm_mul_ps(t2, sin_t)));
+		__m128 cos_t = _mm_add_ps(_mm_set1_ps(COS6), _mm_mul_ps(t2, _mm_set1_ps(COS8)));
+		cos_t = _mm_add_ps(_mm_set1_ps(COS4), _mm_mul_ps(t2, cos_t));
+		cos_t = _mm_add_ps(_mm_set1_ps(COS2), _mm_mul_ps(t2, cos_t));
+		cos_t = _mm_add_ps(one, _mm_mul_ps(t2, cos_t));
+
+		__m128 att = _mm_div_ps(one, _mm_add_ps(one, _mm_div_ps(distance, _mm_loadu_ps(radius + i))));
+		__m128 scale = _mm_mul_ps(_mm_set1_ps(SQRT_HALF), att);
+		__m128 l = _mm_mul_ps(_mm_sub_ps(cos_t, sin_t), scale);
+		__m128 r = _mm_mul_ps(_mm_add_ps(cos_t, sin_t), scale);
+
+		//sources at the listener:
+		__m128 sqrt_two = _mm_and_ps(at_listener, _mm_set1_ps(SQRT_TWO));
+		att = _mm_or_ps(_mm_and_ps(at_listener, one), _mm_andnot_ps(at_listener, att));
+		l = _mm_or_ps(sqrt_two, _mm_andnot_ps(at_listener, l));
+		r = _mm_or_ps(sqrt_two, _mm_andnot_ps(at_listener, r));
+
+		_mm_storeu_ps(attenuation + i, att);
+		_mm_storeu_ps(left + i, l);
+		_mm_storeu_ps(right + i, r);
+	}
+
+	//leftover sources:
+	pan_scalar(count - i, x + i, y + i, z + i, radius + i, listener, listener_right, attenuation + i, left + i, right + i);
+}
+
+static void spectrum_sse2(uint32_t count, float const *a_re, float const *a_im, float const *b_re, float const *b_im, float *acc_re, float *acc_im) {
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 ar = _mm_loadu_ps(a_re + i), ai = _mm_loadu_ps(a_im + i);
+		__m128 br = _mm_loadu_ps(b_re + i), bi = _mm_loadu_ps(b_im + i);
+		__m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+		__m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+		_mm_storeu_ps(acc_re + i, _mm_add_ps(_mm_loadu_ps(acc_re + i), re));
+		_mm_storeu_ps(acc_im + i, _mm_add_ps(_mm_loadu_ps(acc_im + i), im));
+	}
+
+	//leftover bins:
+	spectrum_scalar(count - i, a_re + i, a_im + i, b_re + i, b_im + i, acc_re + i, acc_im + i);
+}
+
+TARGET_AVX2
+static void spectrum_avx2(uint32_t count, float const *a_re, float const *a_im, float const *b_re, float const *b_im, float *acc_re, float *acc_im) {
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 ar = _mm256_loadu_ps(a_re + i), ai = _mm256_loadu_ps(a_im + i);
+		__m256 br = _mm256_loadu_ps(b_re + i), bi = _mm256_loadu_ps(b_im + i);
+		__m256 re = _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+		__m256 im = _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+		_mm256_storeu_ps(acc_re + i, _mm256_add_ps(_mm256_loadu_ps(acc_re + i), re));
+		_mm256_storeu_ps(acc_im + i, _mm256_add_ps(_mm256_loadu_ps(acc_im + i), im));
+	}
+	//(avoid AVX-SSE transition penalties in the code that follows)
+	_mm256_zeroupper();
+
+	//leftover bins:
+	spectrum_scalar(count - i, a_re + i, a_im + i, b_re + i, b_im + i, acc_re + i, acc_im + i);
+}
+
+TARGET_AVX2
+static void pan_avx2(uint32_t count, float const *x, float const *y, float const *z, float const *radius,
+	float const listener[3], float const listener_right[3], float *attenuation, float *left, float *right) {
+	__m256 const lx = _mm256_set1_ps(listener[0]), ly = _mm256_set1_ps(listener[1]), lz = _mm256_set1_ps(listener[2]);
+	__m256 const rx = _mm256_set1_ps(listener_right[0]), ry = _mm256_set1_ps(listener_right[1]), rz = _mm256_set1_ps(listener_right[2]);
+	__m256 const zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), minus_one = _mm256_set1_ps(-1.0f);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 tx = _mm256_sub_ps(_mm256_loadu_ps(x + i), lx);
+		__m256 ty = _mm256_sub_ps(_mm256_loadu_ps(y + i), ly);
+		__m256 tz = _mm256_sub_ps(_mm256_loadu_ps(z + i), lz);
+		__m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+		__m256 at_listener = _mm256_cmp_ps(distance, zero, _CMP_EQ_OQ);
+
+		//(lanes at the listener divide by zero here, but are replaced below)
+		__m256 amount = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, tx), _mm256_mul_ps(ry, ty)), _mm256_mul_ps(rz, tz)), distance);
+		amount = _mm256_min_ps(_mm256_max_ps(amount, minus_one), one);
+		__m256 t = _mm256_mul_ps(_mm256_set1_ps(QUARTER_PI), amount);
+		__m256 t2 = _mm256_mul_ps(t, t);
+		__m256 sin_t = _mm256_add_ps(_mm256_set1_ps(SIN5), _mm256_mul_ps(t2, _mm256_set1_ps(SIN7)));
+		sin_t = _mm256_add_ps(_mm256_set1_ps(SIN3), _mm256_mul_ps(t2, sin_t));
+		sin_t = _mm256_mul_ps(t, _mm256_add_ps(one, _mm256_mul_ps(t2, sin_t)));
+		__m256 cos_t = _mm256_add_ps(_mm256_set1_ps(COS6), _mm256_mul_ps(t2, _mm256_set1_ps(COS8)));
+		cos_t = _mm256_add_ps(_mm256_set1_ps(COS4), _mm256_mul_ps(t2, cos_t));
+		cos_t = _mm256_add_ps(_mm256_set1_ps(COS2), _mm256_mul_ps(t2, cos_t));
+		cos_t = _mm256_add_ps(one, _mm256_mul_ps(t2, cos_t));
+
+		__m256 att = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_div_ps(distance, _mm256_loadu_ps(radius + i))));
+		__m256 scale = _mm256_mul_ps(_mm256_set1_ps(SQRT_HALF), att);
+		__m256 l = _mm256_mul_ps(_mm256_sub_ps(cos_t, sin_t), scale);
+		__m256 r = _mm256_mul_ps(_mm256_add_ps(cos_t, sin_t), scale);
+
+		//sources at the listener:
+		__m256 sqrt_two = _mm256_set1_ps(SQRT_TWO);
+		att = _mm256_blendv_ps(att, one, at_listener);
+		l = _mm256_blendv_ps(l, sqrt_two, at_listener);
+		r = _mm256_blendv_ps(r, sqrt_two, at_listener);
+
+		_mm256_storeu_ps(attenuation + i, att);
+		_mm256_storeu_ps(left + i, l);
+		_mm256_storeu_ps(right + i, r);
+	}
+	//(avoid AVX-SSE transition penalties in the code that follows)
+	_mm256_zeroupper();
+
+	//leftover sources:
+	pan_scalar(count - i, x + i, y + i, z + i, radius + i, listener, listener_right, attenuation + i, left + i, right + i);
+}
+
+template< typename Sample >
+TARGET_AVX2
+static void mix_avx2(Sample const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	float scale = gain_scale(src);
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+
+	//gains for frames s .. s+3 as (L R L R L R L R); frames s+4 .. s+7 are one 'step' further along:
+	__m256 gain = _mm256_setr_ps(
+		left, right,
+		left + left_step, right + right_step,
+		left + 2.0f * left_step, right + 2.0f * right_step,
+		left + 3.0f * left_step, right + 3.0f * right_step
+	);
+	__m256 step = _mm256_setr_ps(
+		4.0f * left_step, 4.0f * right_step, 4.0f * left_step, 4.0f * right_step,
+		4.0f * left_step, 4.0f * right_step, 4.0f * left_step, 4.0f * right_step
+	);
+	__m256 step2 = _mm256_add_ps(step, step);
+	__m256i const dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	__m256i const dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+	uint32_t s = 0;
+	for (; s + 8 <= count; s += 8) {
+		__m256 in = load8(src + s); //a b c d e f g h
+		__m256 lo = _mm256_permutevar8x32_ps(in, dup_lo); //a a b b c c d d
+		__m256 hi = _mm256_permutevar8x32_ps(in, dup_hi); //e e f f g g h h
+		__m256 out0 = _mm256_add_ps(_mm256_loadu_ps(dst + 2*s), _mm256_mul_ps(gain, lo));
+		__m256 out1 = _mm256_add_ps(_mm256_loadu_ps(dst + 2*s + 8), _mm256_mul_ps(_mm256_add_ps(gain, step), hi));
+		_mm256_storeu_ps(dst + 2*s, out0);
+		_mm256_storeu_ps(dst + 2*s + 8, out1);
+		gain = _mm256_add_ps(gain, step2);
+	}
+	//(avoid AVX-SSE transition penalties in the code that follows)
+	_mm256_zeroupper();
+
+	//leftover frames:
+	mix_scalar_scaled(src + s, count - s, dst + 2*s, left + s * left_step, right + s * right_step, left_step, right_step);
+}
+
+TARGET_AVX2
+static void stereo_avx2(float const *src, uint32_t count, float *dst, float gain, float gain_step) {
+	//gains for frames s .. s+3 as (g0 g0 g1 g1 g2 g2 g3 g3):
+	__m256 g = _mm256_setr_ps(
+		gain, gain,
+		gain + gain_step, gain + gain_step,
+		gain + 2.0f * gain_step, gain + 2.0f * gain_step,
+		gain + 3.0f * gain_step, gain + 3.0f * gain_step
+	);
+	__m256 step = _mm256_set1_ps(4.0f * gain_step);
+
+	uint32_t s = 0;
+	for (; s + 4 <= count; s += 4) {
+		__m256 out = _mm256_add_ps(_mm256_loadu_ps(dst + 2*s), _mm256_mul_ps(g, _mm256_loadu_ps(src + 2*s)));
+		_mm256_storeu_ps(dst + 2*s, out);
+		g = _mm256_add_ps(g, step);
+	}
+	//(avoid AVX-SSE transition penalties in the code that follows)
+	_mm256_zeroupper();
+
+	//leftover frames:
+	stereo_scalar(src + 2*s, count - s, dst + 2*s, gain + s * gain_step, gain_step);
+}
+
+//does this CPU (and OS) support AVX2 (and F16C)?
+static bool has_avx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool f16c = (info[2] & (1 << 29)) != 0;
+	if (!osxsave || !avx || !f16c) return false;
+	//OS must save the upper halves of the ymm registers:
+	if ((_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init(); //(may run before main, from a static initializer)
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_F16C)) return false;
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+MixKernel const mix_kernel_scalar = mix_scalar< float >;
+MixKernel const mix_kernel_sse2 = mix_sse2< float >;
+MixKernel const mix_kernel_avx2 = has_avx2() ? mix_avx2< float > : nullptr;
+
+MixKernel const mix_mono_to_stereo = has_avx2() ? mix_avx2< float > : mix_sse2< float >;
+char const * const mix_kernel_name = has_avx2() ? "avx2" : "sse2";
+
+StereoKernel const stereo_kernel_scalar = stereo_scalar;
+StereoKernel const stereo_kernel_sse2 = stereo_sse2;
+StereoKernel const stereo_kernel_avx2 = has_avx2() ? stereo_avx2 : nullptr;
+
+StereoKernel const mix_stereo = has_avx2() ? stereo_avx2 : stereo_sse2;
+
+ResampleKernel const resample_kernel_scalar = resample_scalar< float >;
+ResampleKernel const resample_kernel_sse2 = resample_sse2< float >;
+ResampleKernel const resample_kernel_avx2 = has_avx2() ? resample_avx2< float > : nullptr;
+
+ResampleKernel const resample_mono_to_stereo = has_avx2() ? resample_avx2< float > : resample_sse2< float >;
+
+MixKernelInt16 const mix_int16_kernel_scalar = mix_scalar< int16_t >;
+MixKernelInt16 const mix_int16_kernel_sse2 = mix_sse2< int16_t >;
+MixKernelInt16 const mix_int16_kernel_avx2 = has_avx2() ? mix_avx2< int16_t > : nullptr;
+
+MixKernelInt16 const mix_int16_to_stereo = has_avx2() ? mix_avx2< int16_t > : mix_sse2< int16_t >;
+
+MixKernelHalf const mix_half_kernel_scalar = mix_scalar< uint16_t >;
+MixKernelHalf const mix_half_kernel_sse2 = mix_sse2< uint16_t >;
+MixKernelHalf const mix_half_kernel_avx2 = has_avx2() ? mix_avx2< uint16_t > : nullptr;
+
+MixKernelHalf const mix_half_to_stereo = has_avx2() ? mix_avx2< uint16_t > : mix_sse2< uint16_t >;
+
+ResampleKernelInt16 const resample_int16_kernel_scalar = resample_scalar< int16_t >;
+ResampleKernelInt16 const resample_int16_kernel_sse2 = resample_sse2< int16_t >;
+ResampleKernelInt16 const resample_int16_kernel_avx2 = has_avx2() ? resample_avx2< int16_t > : nullptr;
+
+ResampleKernelInt16 const resample_int16_to_stereo = has_avx2() ? resample_avx2< int16_t > : resample_sse2< int16_t >;
+
+ResampleKernelHalf const resample_half_kernel_scalar = resample_scalar< uint16_t >;
+ResampleKernelHalf const resample_half_kernel_sse2 = resample_sse2< uint16_t >;
+ResampleKernelHalf const resample_half_kernel_avx2 = has_avx2() ? resample_avx2< uint16_t > : nullptr;
+
+ResampleKernelHalf const resample_half_to_stereo = has_avx2() ? resample_avx2< uint16_t > : resample_sse2< uint16_t >;
+
+PanKernel const pan_kernel_scalar = pan_scalar;
+PanKernel const pan_kernel_sse2 = pan_sse2;
+PanKernel const pan_kernel_avx2 = has_avx2() ? pan_avx2 : nullptr;
+
+PanKernel const pan_3D = has_avx2() ? pan_avx2 : pan_sse2;
+
+SpectrumKernel const spectrum_kernel_scalar = spectrum_scalar;
+SpectrumKernel const spectrum_kernel_sse2 = spectrum_sse2;
+SpectrumKernel const spectrum_kernel_avx2 = has_avx2() ? spectrum_avx2 : nullptr;
+
+SpectrumKernel const multiply_add_spectrum = has_avx2() ? spectrum_avx2 : spectrum_sse2;
+
+#else //not x86
+
+MixKernel const mix_kernel_scalar = mix_scalar< float >;
+MixKernel const mix_kernel_sse2 = nullptr;
+MixKernel const mix_kernel_avx2 = nullptr;
+
+MixKernel const mix_mono_to_stereo = mix_scalar< float >;
+char const * const mix_kernel_name = "scalar";
+
+StereoKernel const stereo_kernel_scalar = stereo_scalar;
+StereoKernel const stereo_kernel_sse2 = nullptr;
+StereoKernel const stereo_kernel_avx2 = nullptr;
+
+StereoKernel const mix_stereo = stereo_scalar;
+
+ResampleKernel const resample_kernel_scalar = resample_scalar< float >;
+ResampleKernel const resample_kernel_sse2 = nullptr;
+ResampleKernel const resample_kernel_avx2 = nullptr;
+
+ResampleKernel const resample_mono_to_stereo = resample_scalar< float >;
+
+MixKernelInt16 const mix_int16_kernel_scalar = mix_scalar< int16_t >;
+MixKernelInt16 const mix_int16_kernel_sse2 = nullptr;
+MixKernelInt16 const mix_int16_kernel_avx2 = nullptr;
+
+MixKernelInt16 const mix_int16_to_stereo = mix_scalar< int16_t >;
+
+MixKernelHalf const mix_half_kernel_scalar = mix_scalar< uint16_t >;
+MixKernelHalf const mix_half_kernel_sse2 = nullptr;
+MixKernelHalf const mix_half_kernel_avx2 = nullptr;
+
+MixKernelHalf const mix_half_to_stereo = mix_scalar< uint16_t >;
+
+ResampleKernelInt16 const resample_int16_kernel_scalar = resample_scalar< int16_t >;
+ResampleKernelInt16 const resample_int16_kernel_sse2 = nullptr;
+ResampleKernelInt16 const resample_int16_kernel_avx2 = nullptr;
+
+ResampleKernelInt16 const resample_int16_to_stereo = resample_scalar< int16_t >;
+
+ResampleKernelHalf const resample_half_kernel_scalar = resample_scalar< uint16_t >;
+ResampleKernelHalf const resample_half_kernel_sse2 = nullptr;
+ResampleKernelHalf const resample_half_kernel_avx2 = nullptr;
+
+ResampleKernelHalf const resample_half_to_stereo = resample_scalar< uint16_t >;
+
+PanKernel const pan_kernel_scalar = pan_scalar;
+PanKernel const pan_kernel_sse2 = nullptr;
+PanKernel const pan_kernel_avx2 = nullptr;
+
+PanKernel const pan_3D = pan_scalar;
+
+SpectrumKernel const spectrum_kernel_scalar = spectrum_scalar;
+SpectrumKernel const spectrum_kernel_sse2 = nullptr;
+SpectrumKernel const spectrum_kernel_avx2 = nullptr;
+
+SpectrumKernel const multiply_add_spectrum = spectrum_scalar;
+
+#endif
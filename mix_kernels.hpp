@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+
+//Inner loops of the audio mixer.
+//
+//A mix kernel adds 'count' mono samples from 'src' into the interleaved stereo buffer 'dst'
+// (so dst[2*s] is left, dst[2*s+1] is right), with gains that ramp linearly:
+//   dst[2*s+0] += (left + s * left_step) * src[s]
+//   dst[2*s+1] += (right + s * right_step) * src[s]
+//Neither pointer needs any particular alignment.
+typedef void (*MixKernel)(float const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step);
+
+//the fastest kernel this CPU supports (picked once, at startup):
+extern MixKernel const mix_mono_to_stereo;
+//name of that kernel ("avx2", "sse2", or "scalar"):
+extern char const * const mix_kernel_name;
+
+//individual kernels, for benchmarking and comparison (nullptr if not supported on this CPU/compiler):
+extern MixKernel const mix_kernel_scalar;
+extern MixKernel const mix_kernel_sse2;
+extern MixKernel const mix_kernel_avx2;
+
+//A stereo kernel adds 'count' interleaved stereo frames from 'src' into 'dst' (e.g., a bus into the output),
+// with a gain that ramps linearly:
+//   dst[2*s+c] += (gain + s * gain_step) * src[2*s+c]
+typedef void (*StereoKernel)(float const *src, uint32_t count, float *dst, float gain, float gain_step);
+
+//the fastest stereo kernel this CPU supports (same kind as mix_mono_to_stereo):
+extern StereoKernel const mix_stereo;
+
+//individual kernels, as above:
+extern StereoKernel const stereo_kernel_scalar;
+extern StereoKernel const stereo_kernel_sse2;
+extern StereoKernel const stereo_kernel_avx2;
+
+//A resample kernel is the same, except that it reads 'src' at fractional positions (for pitch/rate changes):
+//  frame s is interpolated around position p = 'position' + s * 'step' (both 32.32 fixed point),
+//  from src[floor(p) - RESAMPLE_TAPS/2 + 1 .. floor(p) + RESAMPLE_TAPS/2], weighted by the
+//  RESAMPLE_TAPS coefficients in 'filter' for phase (p's fraction * RESAMPLE_PHASES).
+//The caller makes sure that every one of those taps is inside 'src'.
+constexpr uint32_t const RESAMPLE_TAPS = 16;
+constexpr uint32_t const RESAMPLE_PHASE_BITS = 8;
+constexpr uint32_t const RESAMPLE_PHASES = 1 << RESAMPLE_PHASE_BITS;
+typedef void (*ResampleKernel)(float const *src, uint64_t position, uint64_t step, uint32_t count, float const *filter, float *dst, float left, float right, float left_step, float right_step);
+
+//fill 'filter' (RESAMPLE_PHASES * RESAMPLE_TAPS floats) with a windowed-sinc lowpass;
+// 'cutoff' is a fraction of the source's Nyquist frequency (use less than 1/rate when rate > 1 to avoid aliasing):
+void make_resample_filter(float cutoff, float *filter);
+
+//the fastest resample kernel this CPU supports (same kind as mix_mono_to_stereo):
+extern ResampleKernel const resample_mono_to_stereo;
+
+//individual kernels, as above:
+extern ResampleKernel const resample_kernel_scalar;
+extern ResampleKernel const resample_kernel_sse2;
+extern ResampleKernel const resample_kernel_avx2;
+
+//Samples can also be kept in two bytes each, rather than four (see Sound::Sample::Storage):
+//  int16 -- int16_t, scaled so that 32768 is 1.0
+//  half -- uint16_t holding an IEEE 754 half-precision float
+//Converting one value at a time (rounding to nearest; int16 clips to [-1, 32767/32768], half to +/-65504,
+// and NaN becomes 0 -- so stored halves are always finite, which lets the SSE2 kernels skip infinity and NaN):
+int16_t float_to_int16(float value);
+float int16_to_float(int16_t value);
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t value);
+
+//Mix and resample kernels for these work exactly like the ones above, except that they widen 'src' to float as they read it:
+typedef void (*MixKernelInt16)(int16_t const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step);
+typedef void (*MixKernelHalf)(uint16_t const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step);
+typedef void (*ResampleKernelInt16)(int16_t const *src, uint64_t position, uint64_t step, uint32_t count, float const *filter, float *dst, float left, float right, float left_step, float right_step);
+typedef void (*ResampleKernelHalf)(uint16_t const *src, uint64_t position, uint64_t step, uint32_t count, float const *filter, float *dst, float left, float right, float left_step, float right_step);
+
+//the fastest kernels this CPU supports (same kind as mix_mono_to_stereo):
+extern MixKernelInt16 const mix_int16_to_stereo;
+extern MixKernelHalf const mix_half_to_stereo;
+extern ResampleKernelInt16 const resample_int16_to_stereo;
+extern ResampleKernelHalf const resample_half_to_stereo;
+
+//individual kernels, as above:
+extern MixKernelInt16 const mix_int16_kernel_scalar;
+extern MixKernelInt16 const mix_int16_kernel_sse2;
+extern MixKernelInt16 const mix_int16_kernel_avx2;
+extern MixKernelHalf const mix_half_kernel_scalar;
+extern MixKernelHalf const mix_half_kernel_sse2;
+extern MixKernelHalf const mix_half_kernel_avx2;
+extern ResampleKernelInt16 const resample_int16_kernel_scalar;
+extern ResampleKernelInt16 const resample_int16_kernel_sse2;
+extern ResampleKernelInt16 const resample_int16_kernel_avx2;
+extern ResampleKernelHalf const resample_half_kernel_scalar;
+extern ResampleKernelHalf const resample_half_kernel_sse2;
+extern ResampleKernelHalf const resample_half_kernel_avx2;
+
+//A pan kernel computes "3D" panning gains for 'count' sources at once, from a structure of arrays:
+//  with 'to' = (x[i], y[i], z[i]) - 'listener', and d = |to|,
+//    attenuation[i] = 1 / (1 + d / radius[i])
+//    left[i] = cos(a) * attenuation[i], right[i] = sin(a) * attenuation[i], where a = (pi/4) * (1 + dot('listener_right', to) / d)
+//  (equal-power panning, from a = 0 at hard left to a = pi/2 at hard right; a source right at the listener
+//   gets sqrt(2) on both sides and no attenuation).
+//sin and cos are polynomials (error below 1e-6), so every kernel gives the same gains to within rounding.
+typedef void (*PanKernel)(uint32_t count, float const *x, float const *y, float const *z, float const *radius,
+	float const listener[3], float const listener_right[3], float *attenuation, float *left, float *right);
+
+//the fastest pan kernel this CPU supports (same kind as mix_mono_to_stereo):
+extern PanKernel const pan_3D;
+
+//individual kernels, as above:
+extern PanKernel const pan_kernel_scalar;
+extern PanKernel const pan_kernel_sse2;
+extern PanKernel const pan_kernel_avx2;
+
+//A spectrum kernel multiplies 'count' pairs of complex numbers, kept as separate real and imaginary
+// arrays, and adds the products to 'acc' (the inner loop of FFT convolution; see HRTF.hpp):
+//   acc_re[i] += a_re[i] * b_re[i] - a_im[i] * b_im[i]
+//   acc_im[i] += a_re[i] * b_im[i] + a_im[i] * b_re[i]
+typedef void (*SpectrumKernel)(uint32_t count, float const *a_re, float const *a_im, float const *b_re, float const *b_im, float *acc_re, float *acc_im);
+
+//the fastest spectrum kernel this CPU supports (same kind as mix_mono_to_stereo):
+extern SpectrumKernel const multiply_add_spectrum;
+
+//individual kernels, as above:
+extern SpectrumKernel const spectrum_kernel_scalar;
+extern SpectrumKernel const spectrum_kernel_sse2;
+extern SpectrumKernel const spectrum_kernel_avx2;
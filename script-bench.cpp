@@ -0,0 +1,97 @@
+//script-bench measures Story::parse on synthetic scripts in the dist/script grammar.
+// usage: script-bench [script file ...]
+//  (any listed script files are benchmarked after the synthetic ones)
+
+#include "Story.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+
+//count every heap allocation made by this program:
+static std::atomic< size_t > allocation_count(0);
+
+void *operator new(size_t size) {
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+//build a script of (at least) 'target_lines' lines:
+static std::string make_script(size_t target_lines) {
+	std::string script =
+		"4\n"
+		"You 1.0 1.0 0.0 1.0\n"
+		"Ole 1.0 0.0 0.0 1.0\n"
+		"Twitter 0.0 0.0 1.0 1.0\n"
+		"Ousmane 0.0 1.0 0.0 1.0\n"
+		"\n";
+	size_t lines = 6;
+	for (size_t b = 0; lines < target_lines; ++b) {
+		script += "Branch" + std::to_string(b) + " 1 -" + std::to_string(b % 50) + " 1 -1\n";
+		for (size_t l = 0; l < 8; ++l) {
+			script += std::to_string(l % 5) + ". The transfer window is open and the phones keep ringing, line "
+				+ std::to_string(l) + ".\n";
+		}
+		script += "-3.\n";
+		for (size_t o = 0; o < 3; ++o) {
+			script += "Option " + std::to_string(o) + " for this branch\n";
+			script += "Branch" + std::to_string(b + 1 + o) + "\n";
+		}
+		script += "\n";
+		lines += 1 + 8 + 1 + 6 + 1;
+	}
+	return script;
+}
+
+static void bench(std::string const &label, std::shared_ptr< std::string const > const &source) {
+	size_t lines = std::count(source->begin(), source->end(), '\n');
+	double best = std::numeric_limits< double >::infinity();
+	size_t allocations = 0;
+	size_t branches = 0;
+	for (uint32_t rep = 0; rep < 5; ++rep) {
+		size_t before = allocation_count.load();
+		auto start = std::chrono::high_resolution_clock::now();
+		Story story = Story::parse(source);
+		auto end = std::chrono::high_resolution_clock::now();
+		allocations = allocation_count.load() - before;
+		branches = story.stories.size();
+		best = std::min(best, std::chrono::duration< double >(end - start).count());
+	}
+
+	double mb = double(source->size()) / (1024.0 * 1024.0);
+	std::cout << std::setw(16) << label
+		<< std::setw(10) << lines << " lines"
+		<< std::setw(9) << std::fixed << std::setprecision(2) << mb << " MB"
+		<< std::setw(10) << std::setprecision(3) << best * 1000.0 << " ms"
+		<< std::setw(10) << std::setprecision(1) << mb / best << " MB/s"
+		<< std::setw(6) << allocations << " allocs/script"
+		<< " (" << branches << " branches)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	for (size_t lines : {10000, 100000, 1000000}) {
+		bench("synthetic " + std::to_string(lines / 1000) + "k", std::make_shared< std::string const >(make_script(lines)));
+	}
+
+	for (int a = 1; a < argc; ++a) {
+		std::ifstream file(argv[a], std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "Failed to open '" << argv[a] << "'." << std::endl;
+			return 1;
+		}
+		auto source = std::make_shared< std::string >(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+		bench(argv[a], source);
+	}
+
+	return 0;
+}
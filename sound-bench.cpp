@@ -0,0 +1,148 @@
+//sound-bench drives the Sound mixer offline (no audio device) with 1 to 2048 voices in several
+// scenarios, and reports how long each block takes to mix against the real-time budget
+// (one block of Sound::block_frames() frames at 48kHz), including tail latencies.
+// ("mixed" is how many of the voices the mixer actually mixed, rather than left virtual, in the last block)
+// usage: sound-bench [blocks per measurement] [block size: 128, 256, 512, or 1024 frames] [sample storage: float, int16, or half]
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//what the voices in a measurement are doing:
+enum Scenario {
+	Static2D, //looping, panned in 2D, nothing changing
+	Static3D, //looping, positioned in 3D around the listener
+	Mixed, //half 2D / half 3D, a quarter one-shots that get restarted as they finish
+	Ramping, //like Mixed, but every voice's volume and pan/position change every block (as in a busy scene)
+	Pitched, //like Static2D, but every voice is resampled (rate != 1)
+};
+static char const *scenario_names[] = { "2D", "3D", "mixed", "ramping", "pitched" };
+
+static float percentile(std::vector< float > const &sorted, float p) {
+	size_t i = std::min(sorted.size() - 1, size_t(p * float(sorted.size() - 1) + 0.5f));
+	return sorted[i];
+}
+
+int main(int argc, char **argv) {
+	uint32_t blocks = 400;
+	if (argc > 1) blocks = uint32_t(std::max(10, std::atoi(argv[1])));
+	if (argc > 2) Sound::set_block_frames(uint32_t(std::max(0, std::atoi(argv[2]))));
+	Sound::Sample::Storage storage = Sound::Sample::Decoded;
+	if (argc > 3) {
+		std::string name = argv[3];
+		if (name == "int16") storage = Sound::Sample::Int16;
+		else if (name == "half") storage = Sound::Sample::Half;
+		else if (name != "float") {
+			std::cerr << "Unknown sample storage '" << name << "'; expecting float, int16, or half." << std::endl;
+			return 1;
+		}
+	}
+
+	float const budget = float(Sound::block_frames()) / 48000.0f;
+
+	//test sounds: a second of noise, and a short loop (wraps several times per block):
+	std::mt19937 mt(0xb10c);
+	std::uniform_real_distribution< float > noise(-0.1f, 0.1f);
+	std::vector< float > long_data(48000), short_data(300), one_shot_data(12000);
+	for (auto &x : long_data) x = noise(mt);
+	for (auto &x : short_data) x = noise(mt);
+	for (auto &x : one_shot_data) x = noise(mt);
+	Sound::Sample long_sample(long_data, storage), short_sample(short_data, storage), one_shot_sample(one_shot_data, storage);
+
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	auto random_position = [&]() {
+		return glm::vec3(10.0f * unit(mt), 10.0f * unit(mt), 2.0f * unit(mt));
+	};
+
+	std::cout << "budget: " << std::fixed << std::setprecision(2) << budget * 1000.0f << " ms per block of " << Sound::block_frames() << " frames; "
+		<< blocks << " blocks per measurement; " << (argc > 3 ? argv[3] : "float") << " samples." << std::endl;
+	std::cout << std::setw(8) << "scenario" << std::setw(7) << "voices" << std::setw(7) << "mixed"
+		<< std::setw(10) << "mean ms" << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "p99.9 ms" << std::setw(10) << "max ms"
+		<< std::setw(12) << "p99/budget" << std::endl;
+
+	std::vector< float > out;
+	std::vector< float > times;
+	for (Scenario scenario : { Static2D, Static3D, Mixed, Ramping, Pitched }) {
+		for (uint32_t count = 1; count <= 2048; count *= 2) {
+			//start from silence:
+			Sound::stop_all_samples();
+			Sound::listener.set_position_right(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f);
+			out.clear();
+			Sound::render(4, &out);
+
+			//start voices:
+			std::vector< Sound::PlayingSample > playing;
+			std::vector< bool > is_3D;
+			for (uint32_t v = 0; v < count; ++v) {
+				Sound::Sample const &sample = (v % 3 == 0 ? short_sample : long_sample);
+				bool use_3D = (scenario == Static3D) || ((scenario == Mixed || scenario == Ramping) && v % 2 == 1);
+				bool one_shot = (scenario == Mixed || scenario == Ramping) && v % 4 == 2;
+				if (one_shot) {
+					playing.emplace_back(Sound::play(one_shot_sample, 0.5f, unit(mt)));
+				} else if (use_3D) {
+					playing.emplace_back(Sound::loop_3D(sample, 0.5f, random_position(), 5.0f));
+				} else {
+					playing.emplace_back(Sound::loop(sample, 0.5f, unit(mt)));
+				}
+				if (scenario == Pitched) playing.back().set_rate(0.75f + 0.5f * (0.5f + 0.5f * unit(mt)), 0.0f);
+				is_3D.emplace_back(use_3D);
+			}
+
+			//warm up, then time each block:
+			out.clear();
+			Sound::render(4, &out);
+			times.clear();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				Sound::update(); //(as the game does each frame; notices finished samples)
+				if (scenario == Mixed || scenario == Ramping) {
+					//restart one-shots that have finished:
+					for (uint32_t v = 2; v < count; v += 4) {
+						if (!playing[v].playing()) playing[v] = Sound::play(one_shot_sample, 0.5f, unit(mt));
+					}
+				}
+				if (scenario == Ramping) {
+					for (uint32_t v = 0; v < count; ++v) {
+						playing[v].set_volume(0.25f + 0.25f * unit(mt), 0.05f);
+						if (is_3D[v]) playing[v].set_position(random_position(), 0.05f);
+						else playing[v].set_pan(unit(mt), 0.05f);
+					}
+					Sound::listener.set_position_right(random_position(), glm::vec3(unit(mt), unit(mt), 0.0f), 0.05f);
+				}
+
+				//(n.b. without an audio device, commands are applied as they are sent, so only mixing is timed)
+				out.clear();
+				auto before = std::chrono::high_resolution_clock::now();
+				Sound::render(1, &out);
+				auto after = std::chrono::high_resolution_clock::now();
+				times.emplace_back(std::chrono::duration< float >(after - before).count());
+			}
+
+			float mean = 0.0f;
+			for (float t : times) mean += t;
+			mean /= float(times.size());
+			std::sort(times.begin(), times.end());
+			float p99 = percentile(times, 0.99f);
+
+			std::cout << std::setw(8) << scenario_names[scenario] << std::setw(7) << count << std::setw(7) << Sound::get_voice_counts().mixed
+				<< std::setprecision(3)
+				<< std::setw(10) << mean * 1000.0f
+				<< std::setw(10) << percentile(times, 0.5f) * 1000.0f
+				<< std::setw(10) << p99 * 1000.0f
+				<< std::setw(10) << percentile(times, 0.999f) * 1000.0f
+				<< std::setw(10) << times.back() * 1000.0f
+				<< std::setw(11) << std::setprecision(1) << 100.0f * p99 / budget << "%"
+				<< (p99 > budget ? "  OVER BUDGET" : "") << std::endl;
+		}
+	}
+
+	Sound::shutdown();
+	return 0;
+}
@@ -0,0 +1,321 @@
+//story-sim plays the story many times with scripted player policies and reports
+// how often each ending is reached, how the stats evolve week by week, and which
+// branches get visited when, so script revisions can be balanced without playtesting.
+//
+// usage: story-sim [options]
+//   --script <file>      script to simulate (default: dist/script)
+//   --start <branch>     branch each episode starts from (default: Opening)
+//   --restart <branch>   endings lead back here; reaching it ends the episode (default: Menu)
+//   --policy <name>      random | fan | budget | scripted (default: random)
+//                          fan: take the option that leaves fan support highest
+//                          budget: take the option that leaves the most budget
+//                          scripted: follow --choices, random where it has no entry
+//   --choices <file>     lines of 'BranchName option' (options numbered from 1, as shown in game)
+//   --episodes <n>       number of episodes to play (default: 1000000)
+//   --threads <n>        worker threads (default: all cores)
+//   --seed <n>           random seed; results don't depend on the thread count (default: 1)
+//   --out <prefix>       write <prefix>-endings.csv, <prefix>-weeks.csv, <prefix>-visits.csv (default: sim)
+
+#include "Story.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	constexpr uint32_t WeekBuckets = 16; //stats for weeks past this are lumped into the last bucket
+	constexpr uint32_t MaxSteps = 1000; //episodes that haven't reached an ending by now are cut off
+
+	//small, fast generator (splitmix64) so that every episode can have its own seed:
+	struct Random {
+		uint64_t state;
+		uint64_t next() {
+			uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			return z ^ (z >> 31);
+		}
+		size_t below(size_t n) { return size_t(next() % n); }
+	};
+
+	enum class Policy { Random, Fan, Budget, Scripted };
+
+	struct Simulation {
+		Story story;
+		std::string_view start;
+		std::string_view restart;
+		Policy policy = Policy::Random;
+		std::unordered_map< std::string_view, size_t > scripted; //branch -> option for Policy::Scripted
+
+		//branches in story.stories order, for indexing the tallies:
+		std::vector< std::string_view > branch_names;
+		std::unordered_map< std::string_view, uint32_t > branch_index;
+	};
+
+	//everything an episode contributes to the report:
+	struct Tally {
+		Tally(size_t branches) : endings(branches + 1, 0), visits(branches * WeekBuckets, 0) { }
+
+		std::vector< uint64_t > endings; //per branch; the extra last entry counts cut-off episodes
+		std::vector< uint64_t > visits; //[branch * WeekBuckets + week]
+		struct Week {
+			uint64_t samples = 0;
+			double sum[3] = {0.0, 0.0, 0.0}; //budget, fan, coach
+			double sum2[3] = {0.0, 0.0, 0.0};
+		};
+		Week weeks[WeekBuckets];
+
+		void add(Tally const &other) {
+			for (size_t i = 0; i < endings.size(); ++i) endings[i] += other.endings[i];
+			for (size_t i = 0; i < visits.size(); ++i) visits[i] += other.visits[i];
+			for (uint32_t w = 0; w < WeekBuckets; ++w) {
+				weeks[w].samples += other.weeks[w].samples;
+				for (uint32_t s = 0; s < 3; ++s) {
+					weeks[w].sum[s] += other.weeks[w].sum[s];
+					weeks[w].sum2[s] += other.weeks[w].sum2[s];
+				}
+			}
+		}
+	};
+
+	uint32_t week_bucket(int week) {
+		return uint32_t(std::clamp(week, 0, int(WeekBuckets) - 1));
+	}
+
+	//pick the option whose outcome (under the real rules) maximizes 'score', breaking ties at random:
+	template< typename Score >
+	size_t pick_best(Simulation const &sim, Story::State const &state, size_t options, Random &random, Score const &score) {
+		size_t best = 0;
+		int best_score = 0;
+		uint32_t ties = 0;
+		for (size_t o = 0; o < options; ++o) {
+			Story::State after = state;
+			sim.story.choose(&after, o);
+			int s = score(after);
+			if (o == 0 || s > best_score) {
+				best = o;
+				best_score = s;
+				ties = 1;
+			} else if (s == best_score && random.below(++ties) == 0) {
+				best = o;
+			}
+		}
+		return best;
+	}
+
+	size_t pick(Simulation const &sim, Story::State const &state, size_t options, Random &random) {
+		switch (sim.policy) {
+			case Policy::Fan:
+				return pick_best(sim, state, options, random, [](Story::State const &s) { return s.fan; });
+			case Policy::Budget:
+				return pick_best(sim, state, options, random, [](Story::State const &s) { return s.budget; });
+			case Policy::Scripted: {
+				auto f = sim.scripted.find(state.branch);
+				if (f != sim.scripted.end() && f->second < options) return f->second;
+				return random.below(options);
+			}
+			case Policy::Random:
+			default:
+				return random.below(options);
+		}
+	}
+
+	void play_episode(Simulation const &sim, uint64_t seed, Tally *tally) {
+		Random random{seed};
+		Story::State state;
+		state.branch = sim.start;
+		for (uint32_t step = 0; step < MaxSteps; ++step) {
+			uint32_t index = sim.branch_index.at(state.branch);
+			tally->visits[index * WeekBuckets + week_bucket(state.week)] += 1;
+
+			Story::Branch const &branch = sim.story.stories.at(state.branch);
+			if (branch.next_branch_names.empty()) {
+				tally->endings[index] += 1;
+				return;
+			}
+
+			sim.story.choose(&state, pick(sim, state, branch.next_branch_names.size(), random));
+			if (state.branch == sim.restart) {
+				//the branch that led back to the menu was an ending:
+				tally->endings[index] += 1;
+				return;
+			}
+
+			Tally::Week &week = tally->weeks[week_bucket(state.week)];
+			double stats[3] = {double(state.budget), double(state.fan), double(state.coach)};
+			week.samples += 1;
+			for (uint32_t s = 0; s < 3; ++s) {
+				week.sum[s] += stats[s];
+				week.sum2[s] += stats[s] * stats[s];
+			}
+		}
+		tally->endings.back() += 1;
+	}
+
+	std::shared_ptr< std::string const > read_file(std::string const &filename) {
+		std::ifstream in(filename, std::ios::binary);
+		if (!in.is_open()) throw std::runtime_error("Failed to open '" + filename + "'.");
+		return std::make_shared< std::string const >(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+	}
+}
+
+int main(int argc, char **argv) {
+	std::string script_filename = "dist/script";
+	std::string start = "Opening";
+	std::string restart = "Menu";
+	std::string policy = "random";
+	std::string choices_filename;
+	uint64_t episodes = 1000000;
+	uint32_t threads = std::max(1U, std::thread::hardware_concurrency());
+	uint64_t seed = 1;
+	std::string out_prefix = "sim";
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (argi + 1 >= argc) {
+			std::cerr << "Option '" << arg << "' needs a value (see the top of story-sim.cpp for usage)." << std::endl;
+			return 1;
+		}
+		std::string value = argv[++argi];
+		if (arg == "--script") script_filename = value;
+		else if (arg == "--start") start = value;
+		else if (arg == "--restart") restart = value;
+		else if (arg == "--policy") policy = value;
+		else if (arg == "--choices") choices_filename = value;
+		else if (arg == "--episodes") episodes = std::stoull(value);
+		else if (arg == "--threads") threads = uint32_t(std::max(1UL, std::stoul(value)));
+		else if (arg == "--seed") seed = std::stoull(value);
+		else if (arg == "--out") out_prefix = value;
+		else {
+			std::cerr << "Unknown option '" << arg << "' (see the top of story-sim.cpp for usage)." << std::endl;
+			return 1;
+		}
+	}
+
+	Simulation sim;
+	sim.story = Story::parse(read_file(script_filename));
+
+	if (policy == "random") sim.policy = Policy::Random;
+	else if (policy == "fan") sim.policy = Policy::Fan;
+	else if (policy == "budget") sim.policy = Policy::Budget;
+	else if (policy == "scripted") sim.policy = Policy::Scripted;
+	else {
+		std::cerr << "Unknown policy '" << policy << "'." << std::endl;
+		return 1;
+	}
+
+	for (auto const &[name, branch] : sim.story.stories) {
+		sim.branch_index.emplace(name, uint32_t(sim.branch_names.size()));
+		sim.branch_names.emplace_back(name);
+	}
+	//start and restart branches, as views that live as long as the story:
+	for (auto [name, view] : {std::make_pair(&start, &sim.start), std::make_pair(&restart, &sim.restart)}) {
+		auto f = sim.story.stories.find(*name);
+		if (f == sim.story.stories.end()) {
+			std::cerr << "Branch '" << *name << "' is not in the script." << std::endl;
+			return 1;
+		}
+		*view = f->first;
+	}
+
+	std::shared_ptr< std::string const > choices;
+	if (!choices_filename.empty()) {
+		choices = read_file(choices_filename);
+		std::istringstream lines(*choices);
+		std::string name;
+		size_t option;
+		while (lines >> name >> option) {
+			auto f = sim.story.stories.find(name);
+			if (f == sim.story.stories.end() || option < 1 || option > f->second.next_branch_names.size()) {
+				std::cerr << "Choice '" << name << " " << option << "' doesn't match the script." << std::endl;
+				return 1;
+			}
+			sim.scripted[f->first] = option - 1;
+		}
+	}
+
+	//play episodes on all threads, handing out work in chunks:
+	auto before = std::chrono::high_resolution_clock::now();
+	constexpr uint64_t Chunk = 4096;
+	std::atomic< uint64_t > next_episode(0);
+	std::vector< Tally > tallies(threads, Tally(sim.branch_names.size()));
+	std::vector< std::thread > workers;
+	for (uint32_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&sim, &next_episode, &tallies, t, episodes, seed](){
+			while (true) {
+				uint64_t begin = next_episode.fetch_add(Chunk);
+				if (begin >= episodes) break;
+				uint64_t end = std::min(episodes, begin + Chunk);
+				for (uint64_t e = begin; e < end; ++e) {
+					//each episode gets its own seed, so results don't depend on which thread plays it:
+					play_episode(sim, Random{seed ^ (e * 0xd1b54a32d192ed03ULL)}.next(), &tallies[t]);
+				}
+			}
+		});
+	}
+	for (auto &w : workers) w.join();
+	auto after = std::chrono::high_resolution_clock::now();
+
+	Tally total(sim.branch_names.size());
+	for (auto const &t : tallies) total.add(t);
+
+	double seconds = std::chrono::duration< double >(after - before).count();
+	std::cout << "Played " << episodes << " episodes (policy '" << policy << "') on " << threads << " threads in "
+	          << seconds << "s (" << double(episodes) / seconds << " episodes/s)." << std::endl;
+
+	//--- report ---
+	{ //ending frequencies:
+		std::ofstream csv(out_prefix + "-endings.csv");
+		csv << "ending,count,fraction\n";
+		for (size_t b = 0; b < total.endings.size(); ++b) {
+			if (total.endings[b] == 0) continue;
+			std::string name = (b < sim.branch_names.size() ? std::string(sim.branch_names[b]) : "(no ending after " + std::to_string(MaxSteps) + " steps)");
+			double fraction = double(total.endings[b]) / double(episodes);
+			csv << name << "," << total.endings[b] << "," << fraction << "\n";
+			std::cout << "  " << name << ": " << 100.0 * fraction << "%" << std::endl;
+		}
+	}
+	{ //stat trajectories, over every choice made in each week:
+		std::ofstream csv(out_prefix + "-weeks.csv");
+		csv << "week,samples,budget_mean,budget_stddev,fan_mean,fan_stddev,coach_mean,coach_stddev\n";
+		for (uint32_t w = 0; w < WeekBuckets; ++w) {
+			Tally::Week const &week = total.weeks[w];
+			if (week.samples == 0) continue;
+			csv << w << "," << week.samples;
+			for (uint32_t s = 0; s < 3; ++s) {
+				double mean = week.sum[s] / week.samples;
+				double variance = std::max(0.0, week.sum2[s] / week.samples - mean * mean);
+				csv << "," << mean << "," << std::sqrt(variance);
+			}
+			csv << "\n";
+		}
+	}
+	{ //branch visit heatmap (branches x weeks):
+		std::ofstream csv(out_prefix + "-visits.csv");
+		csv << "branch";
+		for (uint32_t w = 0; w < WeekBuckets; ++w) csv << ",week" << w;
+		csv << ",total\n";
+		for (size_t b = 0; b < sim.branch_names.size(); ++b) {
+			uint64_t sum = 0;
+			csv << sim.branch_names[b];
+			for (uint32_t w = 0; w < WeekBuckets; ++w) {
+				uint64_t v = total.visits[b * WeekBuckets + w];
+				csv << "," << v;
+				sum += v;
+			}
+			csv << "," << sum << "\n";
+		}
+	}
+	std::cout << "Wrote " << out_prefix << "-endings.csv, " << out_prefix << "-weeks.csv, " << out_prefix << "-visits.csv." << std::endl;
+
+	return 0;
+}